@@ -0,0 +1,224 @@
+/* gl_state.cpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "gl_state.hpp"
+
+static uint64_t float_bits(GLfloat f) {
+	uint32_t u;
+	memcpy(&u, &f, sizeof u);
+	return u;
+}
+
+gl_state::gl_state()
+	: npot_mipmaps(-1), issued(0), skipped(0),
+	frame_issued(0), frame_skipped(0),
+	total_issued(0), total_skipped(0)
+{
+	invalidate();
+}
+
+void gl_state::invalidate() {
+	program = (GLuint)-1;
+	active_unit = GL_NONE;
+	for (auto &&t : texture_2d) {
+		t = (GLuint)-1;
+	}
+	for (int i = 0; i < MAX_ATTRIBS; i++) {
+		attrib_enabled[i] = -1;
+		attrib_pointer[i] = NULL;
+	}
+	viewport_box[0] = viewport_box[1] = -1;
+	viewport_box[2] = viewport_box[3] = -1;
+	blend = -1;
+	blend_src = blend_dst = GL_NONE;
+	uniform_dict.clear();
+}
+
+void gl_state::use_program(GLuint p) {
+	if (filter(p == program)) {
+		return;
+	}
+	glUseProgram(p);
+	program = p;
+}
+
+void gl_state::active_texture(GLenum unit) {
+	if (filter(unit == active_unit)) {
+		return;
+	}
+	glActiveTexture(unit);
+	active_unit = unit;
+}
+
+void gl_state::bind_texture(GLuint tex) {
+	int unit = active_unit == GL_NONE ? 0 : active_unit - GL_TEXTURE0;
+	if (unit < 0 || unit >= MAX_UNITS) {
+		issued++;
+		glBindTexture(GL_TEXTURE_2D, tex);
+		return;
+	}
+	if (filter(texture_2d[unit] == tex)) {
+		return;
+	}
+	glBindTexture(GL_TEXTURE_2D, tex);
+	texture_2d[unit] = tex;
+}
+
+bool gl_state::set_uniform(GLint location, uint64_t a, uint64_t b) {
+	if (location < 0) {
+		return false;
+	}
+	auto key = std::make_pair(program, location);
+	auto value = std::make_pair(a, b);
+	auto it = uniform_dict.find(key);
+	if (filter(it != uniform_dict.end() && it->second == value)) {
+		return false;
+	}
+	uniform_dict[key] = value;
+	return true;
+}
+
+void gl_state::uniform1i(GLint location, GLint v) {
+	if (set_uniform(location, (uint32_t)v, 0)) {
+		glUniform1i(location, v);
+	}
+}
+
+void gl_state::uniform1f(GLint location, GLfloat v) {
+	if (set_uniform(location, float_bits(v), 0)) {
+		glUniform1f(location, v);
+	}
+}
+
+void gl_state::uniform2f(GLint location, GLfloat x, GLfloat y) {
+	if (set_uniform(location, float_bits(x), float_bits(y))) {
+		glUniform2f(location, x, y);
+	}
+}
+
+void gl_state::uniform4f(GLint location, GLfloat x, GLfloat y, GLfloat z,
+		GLfloat w) {
+	if (set_uniform(location, float_bits(x) << 32 | float_bits(y),
+				float_bits(z) << 32 | float_bits(w))) {
+		glUniform4f(location, x, y, z, w);
+	}
+}
+
+void gl_state::enable_vertex_attrib_array(GLuint index) {
+	if (index < MAX_ATTRIBS && filter(attrib_enabled[index] == 1)) {
+		return;
+	}
+	glEnableVertexAttribArray(index);
+	if (index < MAX_ATTRIBS) {
+		attrib_enabled[index] = 1;
+	}
+}
+
+void gl_state::disable_vertex_attrib_array(GLuint index) {
+	if (index < MAX_ATTRIBS && filter(attrib_enabled[index] == 0)) {
+		return;
+	}
+	glDisableVertexAttribArray(index);
+	if (index < MAX_ATTRIBS) {
+		attrib_enabled[index] = 0;
+	}
+}
+
+void gl_state::vertex_attrib_pointer(GLuint index, GLint size,
+		const void *ptr) {
+	if (index < MAX_ATTRIBS && filter(attrib_pointer[index] == ptr)) {
+		return;
+	}
+	glVertexAttribPointer(index, size, GL_FLOAT, GL_FALSE, 0, ptr);
+	if (index < MAX_ATTRIBS) {
+		attrib_pointer[index] = ptr;
+	}
+}
+
+void gl_state::viewport(GLint x, GLint y, GLsizei w, GLsizei h) {
+	if (filter(viewport_box[0] == x && viewport_box[1] == y &&
+				viewport_box[2] == w && viewport_box[3] == h)) {
+		return;
+	}
+	glViewport(x, y, w, h);
+	viewport_box[0] = x;
+	viewport_box[1] = y;
+	viewport_box[2] = w;
+	viewport_box[3] = h;
+}
+
+void gl_state::set_blend(bool enable) {
+	if (filter(blend == (int)enable)) {
+		return;
+	}
+	if (enable) {
+		glEnable(GL_BLEND);
+	} else {
+		glDisable(GL_BLEND);
+	}
+	blend = enable;
+}
+
+void gl_state::blend_func(GLenum src, GLenum dst) {
+	if (filter(src == blend_src && dst == blend_dst)) {
+		return;
+	}
+	glBlendFunc(src, dst);
+	blend_src = src;
+	blend_dst = dst;
+}
+
+bool gl_state::can_mipmap(int32_t width, int32_t height) {
+	if (npot_mipmaps < 0) {
+		const char *ext = (const char *)glGetString(GL_EXTENSIONS);
+		npot_mipmaps = ext && strstr(ext, "GL_OES_texture_npot") ? 1 : 0;
+	}
+	return npot_mipmaps || (!(width & (width - 1)) &&
+			!(height & (height - 1)));
+}
+
+void gl_state::end_frame() {
+	frame_issued = issued;
+	frame_skipped = skipped;
+	total_issued += issued;
+	total_skipped += skipped;
+	issued = skipped = 0;
+}
+
+std::string gl_state::describe() {
+	char out[256];
+	snprintf(out, sizeof out,
+			"gl_calls_frame %llu\n"
+			"gl_calls_skipped_frame %llu\n"
+			"gl_calls_total %llu\n"
+			"gl_calls_skipped_total %llu\n",
+			(unsigned long long)frame_issued,
+			(unsigned long long)frame_skipped,
+			(unsigned long long)total_issued,
+			(unsigned long long)total_skipped);
+	return out;
+}
+
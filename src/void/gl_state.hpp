@@ -0,0 +1,116 @@
+/* gl_state.hpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __GL_STATE_HPP_
+#define __GL_STATE_HPP_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <map>
+#include <string>
+
+#include <GLES2/gl2.h>
+
+/* glGetError() may stall the pipeline, only check in debug builds */
+#ifdef VOID_GL_DEBUG
+#define GL_CHECK_ERROR() gl_print_error()
+#else
+#define GL_CHECK_ERROR() do {} while (0)
+#endif
+
+void gl_print_error();
+
+/**
+ * Shadow of the GL state the compositor touches, for one context.
+ *
+ * Calls that would set what is already set are dropped. Anything that
+ * changes state behind its back must call invalidate().
+ */
+class gl_state {
+private:
+	static const int MAX_UNITS = 4;
+	static const int MAX_ATTRIBS = 4;
+
+	GLuint program;
+	GLenum active_unit;
+	GLuint texture_2d[MAX_UNITS];
+	/* -1 unknown, 0 off, 1 on */
+	int attrib_enabled[MAX_ATTRIBS];
+	const void *attrib_pointer[MAX_ATTRIBS];
+	GLint viewport_box[4];
+	int blend;
+	GLenum blend_src, blend_dst;
+	/* -1 until asked */
+	int npot_mipmaps;
+	/* (program, location) -> packed value */
+	std::map<std::pair<GLuint, GLint>, std::pair<uint64_t, uint64_t>> uniform_dict;
+
+	uint64_t issued, skipped;
+	std::atomic<uint64_t> frame_issued, frame_skipped;
+	std::atomic<uint64_t> total_issued, total_skipped;
+
+	bool filter(bool same) {
+		if (same) {
+			skipped++;
+			return true;
+		}
+		issued++;
+		return false;
+	}
+	bool set_uniform(GLint location, uint64_t a, uint64_t b);
+
+public:
+	gl_state();
+
+	void invalidate();
+
+	void use_program(GLuint p);
+	void active_texture(GLenum unit);
+	void bind_texture(GLuint tex);
+	void uniform1i(GLint location, GLint v);
+	void uniform1f(GLint location, GLfloat v);
+	void uniform2f(GLint location, GLfloat x, GLfloat y);
+	void uniform4f(GLint location, GLfloat x, GLfloat y, GLfloat z,
+			GLfloat w);
+	void enable_vertex_attrib_array(GLuint index);
+	void disable_vertex_attrib_array(GLuint index);
+	void vertex_attrib_pointer(GLuint index, GLint size, const void *ptr);
+	void viewport(GLint x, GLint y, GLsizei w, GLsizei h);
+	void set_blend(bool enable);
+	void blend_func(GLenum src, GLenum dst);
+
+	/* GLES2 only has mipmaps for non power of two sizes by extension */
+	bool can_mipmap(int32_t width, int32_t height);
+
+	/* counts calls that are not filtered, e.g. draws and uploads */
+	void count_call(int n = 1) {
+		issued += n;
+	}
+
+	void end_frame();
+	std::string describe();
+};
+
+#endif
+
@@ -26,6 +26,7 @@
 
 #include <sys/time.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 #include <iostream>
@@ -35,6 +36,11 @@
 #include <map>
 #include <unordered_map>
 #include <thread>
+#include <chrono>
+#include <algorithm>
+#include <sstream>
+
+#include <linux/input.h>
 
 #include <wayland-util.hpp>
 #include <wayland-shm.hpp>
@@ -52,6 +58,7 @@
 #include <pixman-1/pixman.h>
 
 #include "helper.hpp"
+#include "void_hash.hpp"
 #include "wrapper.hpp"
 
 using namespace wayland;
@@ -81,45 +88,284 @@ static GLuint make_buffer(
 int void_surface::bind(surface_resource_t surf) {
 	//surface_resource_t(surf) {
 	resource = surf;
+	resource.set_user_data(this);
+
+	client = compositor->get_client(surf.get_client());
+	client->ref_object(void_client::OBJ_SURFACE);
 
 	// lambda functions with members captured
 	surf.on_destroy() = [&]() {
+		compositor->destroy_surface(this);
 	};
 
 	surf.on_attach() = [&](wayland::buffer_resource_t buf_res, int x, int y) {
-		cout << "attach buffer(" << buf_res.get_id() << ") to: x(" << x << "), y(" << y << ")" << endl;
-		if (pending.buffer) {
-			pending.buffer->release();
+		TRACE_SCOPE("attach");
+		log_debug(LOG_SURFACE, "attach buffer(%u) to: x(%d), y(%d)",
+				buf_res.get_id(), x, y);
+		state &st = requests();
+		if (st.buffer) {
+			st.buffer->release();
 		}
 		shm_buffer_t *buffer = shm_buffer_t::from_resource(buf_res);
 		//pending.buffer.reset(buffer);
-		pending.newly_attached = true;
-		pending.buffer = buffer;
-		pending.sx = x;
-		pending.sy = y;
+		st.newly_attached = true;
+		st.buffer = buffer;
+		st.sx = x;
+		st.sy = y;
+		record_attached = true;
+		record_x = x;
+		record_y = y;
 		width = buffer->get_width();
 		height = buffer->get_height();
+
+		uint32_t id = buf_res.get_id();
+		if (client->add_buffer(id, (int64_t)buffer->get_stride() * height)) {
+			// buffers outlive the client's accounting when it
+			// disconnects, look it up instead of holding it
+			auto destroy_handler = buf_res.on_destroy();
+			void_compositor *comp = compositor;
+			client_t owner = buf_res.get_client();
+			buf_res.on_destroy() = [comp, owner, id, destroy_handler]() {
+				void_client *c = comp->find_client(owner);
+				if (c) {
+					c->remove_buffer(id);
+				}
+				if (destroy_handler) {
+					destroy_handler();
+				}
+			};
+		}
 	};
 
 	surf.on_frame() = [&](callback_resource_t c) {
-		cout << "frame" << endl;
+		TRACE_SCOPE("frame request");
+		log_trace(LOG_FRAME, "frame");
+		compositor->get_recorder().frame(client->get_id(),
+				resource.get_id());
+		std::lock_guard<std::mutex> lock(frame_mutex);
 		frame_queue.push(c);
+		client->ref_object(void_client::OBJ_CALLBACK);
 	};
 
 	surf.on_damage() = [&](int x, int y, int width, int height) {
-		//cout << "damage: (" << x << ", " << y
-		//	<< ", " << width << ", " << height << ")" << endl;
-		pixman_region32_union_rect(&pending.damage_surface,
-				&pending.damage_surface,
+		log_trace(LOG_SURFACE, "damage: (%d, %d, %d, %d)",
+				x, y, width, height);
+		state &st = requests();
+		pixman_region32_union_rect(&st.damage_surface,
+				&st.damage_surface,
 				x, y, width, height);
+		compositor->get_recorder().damage(client->get_id(),
+				resource.get_id(), x, y, width, height);
+	};
+
+	surf.on_set_buffer_scale() = [&](int32_t scale) {
+		log_trace(LOG_SURFACE, "buffer scale: %d", scale);
+		if (scale < 1) {
+			resource.post_invalid_scale("buffer scale is not positive");
+			return;
+		}
+		state &st = requests();
+		st.buffer_scale = scale;
+		st.new_scale = true;
 	};
 
 	surf.on_commit() = [&]() {
-		//cout << "commit" << endl;
+		TRACE_SCOPE("commit");
+		cost.add_commit();
+		client->get_cost().add_commit();
+		client->get_latency().commit(void_clock::now());
+		log_trace(LOG_SURFACE, "commit");
+		if (viewport) {
+			state &st = requests();
+			int32_t scale = st.new_scale ? st.buffer_scale :
+				pending.buffer_scale;
+			if (!viewport->check(st.buffer ? st.buffer : pending.buffer,
+						scale, st.src_x, st.src_y, st.src_w,
+						st.src_h, st.dst_w)) {
+				return;
+			}
+		}
+		// a buffer for the last configure lets the next one go
+		compositor->get_grab().committed(this, record_attached);
+		record_commit();
 		//swap(pending, current);
+		if (subsurface && subsurface->is_synchronized()) {
+			// shown with the parent's next commit
+			merge_state(staged, cached);
+		} else {
+			commit_children();
+		}
+		if (!entered && (pending.buffer || cached.buffer)) {
+			// mapped, the client can pick the output's scale
+			compositor->get_output().enter(resource);
+			entered = true;
+		}
+		if (client->check_limits() == void_client::LIMIT_HARD) {
+			// the client gets disconnected once the error is sent
+			resource.post_no_memory();
+		}
 	};
 }
 
+/* the buffer is read at commit, when the client is done drawing into it */
+void void_surface::record_commit() {
+	void_recorder &rec = compositor->get_recorder();
+	if (!rec.is_active()) {
+		record_attached = false;
+		return;
+	}
+	uint32_t cid = client->get_id();
+	uint32_t sid = resource.get_id();
+	if (record_attached && requests().buffer) {
+		shm_buffer_t *buf = requests().buffer;
+		rec_buffer b;
+		b.x = record_x;
+		b.y = record_y;
+		b.width = buf->get_width();
+		b.height = buf->get_height();
+		b.stride = buf->get_stride();
+		b.format = (uint32_t)buf->get_format();
+		void_format fmt;
+		size_t size = (size_t)b.stride * b.height;
+		if (fmt.describe(buf->get_format(), b.width, b.height, b.stride)) {
+			size = fmt.size();
+		}
+		rec.buffer(cid, sid, b, buf->get_data(), size);
+	}
+	record_attached = false;
+	rec.commit(cid, sid);
+}
+
+void_surface::state &void_surface::requests() {
+	if (subsurface && subsurface->is_synchronized()) {
+		return staged;
+	}
+	return pending;
+}
+
+/* a later attach replaces the buffer, damage adds up */
+void void_surface::merge_state(state &from, state &to) {
+	if (from.newly_attached) {
+		if (to.buffer && to.buffer != from.buffer) {
+			to.buffer->release();
+		}
+		to.buffer = from.buffer;
+		to.newly_attached = true;
+		to.sx += from.sx;
+		to.sy += from.sy;
+		from.buffer = NULL;
+		from.newly_attached = false;
+		from.sx = from.sy = 0;
+	}
+	if (from.new_viewport) {
+		to.new_viewport = true;
+		to.src_x = from.src_x;
+		to.src_y = from.src_y;
+		to.src_w = from.src_w;
+		to.src_h = from.src_h;
+		to.dst_w = from.dst_w;
+		to.dst_h = from.dst_h;
+		from.new_viewport = false;
+	}
+	if (from.new_scale) {
+		to.new_scale = true;
+		to.buffer_scale = from.buffer_scale;
+		from.new_scale = false;
+	}
+	pixman_region32_union(&to.damage_surface, &to.damage_surface,
+			&from.damage_surface);
+	pixman_region32_clear(&from.damage_surface);
+}
+
+void void_surface::set_source(double x, double y, double w, double h) {
+	state &st = requests();
+	st.src_x = x;
+	st.src_y = y;
+	st.src_w = w;
+	st.src_h = h;
+	st.new_viewport = true;
+}
+
+void void_surface::set_destination(int32_t w, int32_t h) {
+	state &st = requests();
+	st.dst_w = w > 0 ? w : 0;
+	st.dst_h = h > 0 ? h : 0;
+	st.new_viewport = true;
+}
+
+/*
+ * The destination size, else the source's, else the buffer's divided
+ * by its scale; all in surface coordinates.
+ */
+void void_surface::get_size(shm_buffer_t &buf, int32_t &w, int32_t &h) {
+	if (pending.dst_w > 0) {
+		w = pending.dst_w;
+		h = pending.dst_h;
+	} else if (pending.src_w >= 0) {
+		w = (int32_t)pending.src_w;
+		h = (int32_t)pending.src_h;
+	} else {
+		w = buf.get_width() / pending.buffer_scale;
+		h = buf.get_height() / pending.buffer_scale;
+	}
+}
+
+/* dispatch thread: sub-surfaces only change with their parent's commit */
+void void_surface::commit_children() {
+	for (auto s : stack) {
+		if (s != this) {
+			s->subsurface->parent_committed();
+		}
+	}
+}
+
+void void_surface::apply_cached() {
+	merge_state(cached, pending);
+	commit_children();
+}
+
+void void_surface::flush_cached() {
+	merge_state(cached, pending);
+	merge_state(staged, pending);
+}
+
+void_surface *void_surface::get_root() {
+	void_surface *s = this;
+	while (s->subsurface && s->subsurface->get_parent()) {
+		s = s->subsurface->get_parent();
+	}
+	return s;
+}
+
+void void_surface::collect_stack(std::vector<void_surface *> &out) {
+	// sub-surfaces are only mapped along with their parent
+	if (stack.empty() || !pending.buffer) {
+		out.push_back(this);
+		return;
+	}
+	for (auto s : stack) {
+		if (s == this) {
+			out.push_back(this);
+		} else {
+			s->collect_stack(out);
+		}
+	}
+}
+
+void void_surface::set_title(const std::string &t) {
+	compositor->get_recorder().title(client->get_id(), resource.get_id(), t);
+	std::lock_guard<std::mutex> lock(info_mutex);
+	title = t;
+}
+
+void void_surface::set_app_id(const std::string &id) {
+	compositor->get_recorder().app_id(client->get_id(), resource.get_id(),
+			id);
+	qos = compositor->get_qos().lookup(id);
+	std::lock_guard<std::mutex> lock(info_mutex);
+	app_id = id;
+}
+
 surface_resource_t &void_surface::get_resource() {
 	return resource;
 }
@@ -138,34 +384,217 @@ std::vector<float> void_surface::to_screen_space(std::vector<int> v)
 }
 
 void void_surface::frame_done() {
+	std::lock_guard<std::mutex> lock(frame_mutex);
 	if (frame_queue.empty()) {
 		return;
 	}
-	timeval tv;
-	gettimeofday(&tv, 0);
-	uint32_t x = tv.tv_sec * 1000 + tv.tv_usec / 1000;
-
-	frame_queue.front().send_done(x);
+	last_frame_done = void_clock::now();
+	frame_queue.front().send_done(void_clock::now_ms());
 	frame_queue.pop();
+	frame_withheld = false;
+	client->unref_object(void_client::OBJ_CALLBACK);
+}
+
+bool void_surface::withhold_frame() {
+	std::lock_guard<std::mutex> lock(frame_mutex);
+	if (frame_queue.empty() || frame_withheld) {
+		return false;
+	}
+	frame_withheld = true;
+	return true;
+}
+
+qos_priority void_surface::get_priority() {
+	if (!view->is_visible()) {
+		return QOS_OCCLUDED;
+	}
+	return focused ? QOS_FOCUSED : QOS_BACKGROUND;
+}
+
+/*
+ * Render thread: whether a frame callback may go out now, as often as
+ * the policy allows for the surface's priority. Surfaces that have not
+ * shown anything yet always get one.
+ */
+bool void_surface::wants_frame(uint64_t now) {
+	if (!pending.buffer) {
+		return true;
+	}
+	qos_priority p = get_priority();
+	int hz = qos.load(std::memory_order_relaxed)->frame_rate[p];
+	if (p == QOS_OCCLUDED && hz == 0) {
+		return false;
+	}
+	return compositor->get_qos().allows(hz, now, last_frame_done);
+}
+
+void void_surface::release_texture() {
+	void_texture_pool &pool = compositor->get_texture_pool();
+	if (upload_job) {
+		compositor->get_uploader().finish(upload_job);
+		upload_job = NULL;
+		client->remove_texture(back_texture.get_bytes());
+		pool.release(back_texture);
+	}
+	if (!texture.id) {
+		return;
+	}
+	int64_t bytes = texture_bytes();
+	client->remove_texture(bytes);
+	compositor->get_texture_budget().remove(texture_link, bytes);
+	pool.release(texture);
+	pool.release(chroma[0]);
+	pool.release(chroma[1]);
+	tex_width = tex_height = 0;
+}
+
+/* all planes of what is on screen */
+int64_t void_surface::texture_bytes() {
+	return texture.get_bytes() + chroma[0].get_bytes() +
+		chroma[1].get_bytes();
+}
+
+void void_surface::evict_texture() {
+	release_texture();
+	evicted = true;
 }
 
 
 
 void_surface::void_surface(void_compositor *c)
-	: compositor(c), view(NULL)
+	: compositor(c), client(NULL), view(NULL), frame_withheld(false),
+	subsurface(NULL), viewport(NULL),
+	tex_width(0), tex_height(0), tex_shader(SHADER_RGBA),
+	last_drawn(0), evicted(false), last_frame_done(0), last_upload(0),
+	focused(false), qos(c->get_qos().get_default()),
+	row_seed(0), changed_streak(0),
+	back_width(0), back_height(0), back_shader(SHADER_RGBA),
+	upload_job(NULL),
+	destroyed(false), entered(false),
+	record_attached(false), record_x(0), record_y(0)
 {
 	shader = c->get_shader();
 }
-void void_surface::draw() {
 
-	glUseProgram(shader->program);
+/* render thread, right after the previous frame was swapped */
+void void_surface::prepare(pixman_region32_t *output_damage) {
+	if (!pending.buffer) {
+		return;
+	}
 
-	//struct {
-	//	GLuint vertex_buffer, element_buffer;
-	//	GLuint textures[2];
+	shm_buffer_t &buf = *pending.buffer;
+
+	void_texture_budget &budget = compositor->get_texture_budget();
+	last_drawn = compositor->get_frame_count();
 
-	//	/* fields for shader objects ... */
-	//} g_resources;
+	if (upload_job && compositor->get_uploader().ready(upload_job)) {
+		flip_texture();
+		view->add_damage(output_damage, NULL);
+	}
+
+	// low priority surfaces keep showing what they have for a while
+	void_qos &policy = compositor->get_qos();
+	int upload_rate = qos.load(std::memory_order_relaxed)->upload_rate[
+		get_priority()];
+	uint64_t now = void_clock::now();
+	bool defer = false;
+	if (!upload_job && texture.id && pending.newly_attached) {
+		if (!policy.allows(upload_rate, now, last_upload)) {
+			policy.count_upload_deferred();
+			defer = true;
+		} else {
+			defer = compositor->get_governor().skip_upload(focused,
+					compositor->get_frame_count());
+		}
+	}
+	if (!defer && !upload_job && (pending.newly_attached || !texture.id)) {
+		// the texture is kept across frames, only new content is
+		// uploaded; while an upload is in flight the next one waits
+		last_upload = now;
+		if (evicted) {
+			budget.count_reupload();
+			evicted = false;
+		}
+		bool changed = !pending.newly_attached ||
+			!compositor->get_skip_unchanged() ||
+			content_changed(buf);
+		if (changed || !texture.id) {
+			upload(buf);
+			if (!upload_job) {
+				view->add_damage(output_damage,
+						&pending.damage_surface);
+			}
+		} else {
+			// same pixels as in the texture, nothing to repaint
+			client->count_wasted_commit();
+			compositor->get_metrics().add_skipped_upload();
+		}
+		pixman_region32_clear(&pending.damage_surface);
+		pending.newly_attached = false;
+	}
+	if (texture.id) {
+		budget.touch(texture_link);
+	}
+}
+
+/*
+ * Render thread: hashes the damaged rows of a newly attached buffer and
+ * compares them with what was uploaded last. Content that keeps
+ * changing is only hashed every HASH_STREAK commits, the rows are
+ * forgotten in between so nothing stale can match.
+ */
+#define HASH_STREAK 8
+
+bool void_surface::content_changed(shm_buffer_t &buf) {
+	TRACE_SCOPE("hash");
+	int32_t w = buf.get_width();
+	int32_t h = buf.get_height();
+	int32_t stride = buf.get_stride();
+	void_format fmt;
+	if (!fmt.describe(buf.get_format(), w, h, stride)) {
+		return true;
+	}
+	uint64_t seed = ((uint64_t)stride << 32) ^ ((uint64_t)w << 8) ^
+		(uint32_t)buf.get_format();
+	if (seed != row_seed || (int32_t)row_hashes.size() != h) {
+		row_hashes.assign(h, 0);
+		row_seed = seed;
+	}
+
+	// rows outside the damage are unchanged, as far as the client says;
+	// damage is in surface coordinates, a viewport makes them other
+	// units than the buffer's
+	int32_t y1 = 0, y2 = h;
+	if (pixman_region32_not_empty(&pending.damage_surface) &&
+			!is_scaled()) {
+		pixman_box32_t *e = pixman_region32_extents(
+				&pending.damage_surface);
+		y1 = std::max(e->y1 * pending.buffer_scale, 0);
+		y2 = std::min(e->y2 * pending.buffer_scale, h);
+	}
+
+	bool hash = changed_streak < HASH_STREAK ||
+		changed_streak % HASH_STREAK == 0;
+	bool changed = !hash;
+	// a row covers the rows of the chroma planes it is sampled with
+	const uint8_t *data = (const uint8_t *)buf.get_data();
+	for (int32_t y = y1; y < y2; y++) {
+		uint64_t v = 0;
+		for (int i = 0; hash && i < fmt.plane_count; i++) {
+			const void_plane &p = fmt.planes[i];
+			v = void_hash(data + p.offset + (size_t)(y / p.vsub) * p.stride,
+					(size_t)p.width * p.texel_size, i ? v : seed);
+		}
+		if (v != row_hashes[y]) {
+			row_hashes[y] = v;
+			changed = true;
+		}
+	}
+	changed_streak = changed ? changed_streak + 1 : 0;
+	return changed;
+}
+
+void void_surface::draw() {
 	static const GLfloat verts[] = { 
 		-1.0f,  1.0f,
 		-1.0f, -1.0f,
@@ -174,93 +603,341 @@ void void_surface::draw() {
 	};
 	//static const GLushort elements[] = { 0, 1, 2, 3 };
 
-
-	if (!pending.buffer) {
+	if (!texture.id) {
 		return;
 	}
+	TRACE_SCOPE("draw surface");
+	uint64_t start = void_metrics::now();
 
 	if (shader == NULL) {
-		cerr << "No valid shader." << endl;
+		log_error(LOG_RENDER, "No valid shader.");
 		return;
 	}
 
-	int new_x = view->get_left() + pending.sx;
-	int new_y = view->get_top() + pending.sy;
-
-	shm_buffer_t &buf = *pending.buffer;
-
-	int new_width = buf.get_width();
-	int new_height = buf.get_height();
-
-	view->set_geometry(new_x, new_y, new_width, new_height);
-
-	if (pending.newly_attached) {
-		if (buf.get_format() == shm_format::argb8888) {
-			buf.swap_BR_channels();
-		}
-		pending.newly_attached = false;
+	gl_state &gl = compositor->get_gl_state();
+	gl_shader *sh = compositor->get_shader(tex_shader);
+	gl.use_program(sh->program);
+
+	int new_x = view->get_left();
+	int new_y = view->get_top();
+
+	log_trace(LOG_RENDER, "drawing surface(%u)", resource.get_id());
+
+	// the texture may still hold the previous buffer, draw it at its
+	// size, or at the one dragged to while the view is being resized;
+	// a viewport crops in the texcoords and scales with the quad.
+	// Sizes are logical, the output has scale pixels for each, the
+	// buffer buffer_scale texels
+	int32_t scale = compositor->get_scale();
+	int32_t b = pending.buffer_scale;
+	int32_t w = tex_width / b, h = tex_height / b;
+	GLfloat src_x = 0, src_y = 0, src_w = tex_width, src_h = tex_height;
+	if (pending.src_w >= 0) {
+		src_x = pending.src_x * b;
+		src_y = pending.src_y * b;
+		src_w = pending.src_w * b;
+		src_h = pending.src_h * b;
+	}
+	void_grab::preview_mode preview =
+		compositor->get_grab().get_preview(this);
+	if (preview == void_grab::PREVIEW_STRETCH || is_scaled()) {
+		w = view->get_width();
+		h = view->get_height();
+	} else if (preview == void_grab::PREVIEW_PAD) {
+		glEnable(GL_SCISSOR_TEST);
+		glScissor(new_x * scale, (compositor->get_height() -
+					view->get_height() - new_y) * scale,
+				view->get_width() * scale,
+				view->get_height() * scale);
 	}
-
-	//cout << "drawing surface(" << resource.get_id() << ")"
-	//	<< "with attached buffer(" << buf.get_resource().get_id() << ")"
-	//	<< endl;
-
 	int port_x = new_x;
-	int port_y = (compositor->get_height()-height-new_y);
-	glViewport(port_x, port_y, new_width, new_height);
+	int port_y = (compositor->get_height()-h-new_y);
+	gl.viewport(port_x * scale, port_y * scale, w * scale, h * scale);
 	//glMatrixMode(GL_PROJECTION);
 
-	GLint uniform_tex
-		= glGetUniformLocation(shader->program, "tex");
-
-	GLuint texture;
-
-	glGenTextures(1, &texture);
-	glBindTexture(GL_TEXTURE_2D, texture);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,     GL_CLAMP_TO_EDGE);
-	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,     GL_CLAMP_TO_EDGE);
-	glTexImage2D(GL_TEXTURE_2D, 0,
-			GL_RGBA, 
-			buf.get_width(),
-			buf.get_height(),
-			0,
-			GL_RGBA, GL_UNSIGNED_BYTE,
-			buf.get_data());
+	// chroma planes are bound to the next units and sampled at half
+	// the luma texcoords, scaled to their own storage size
+	for (int i = 0; i < 2 && chroma[i].id; i++) {
+		gl.active_texture(GL_TEXTURE1 + i);
+		gl.bind_texture(chroma[i].id);
+		gl.uniform1i(sh->tex_uniforms[1 + i], 1 + i);
+	}
+	if (tex_shader == SHADER_NV12 || tex_shader == SHADER_YUV420) {
+		gl.uniform2f(sh->chromascale_uniform,
+				texture.width / (2.0f * chroma[0].width),
+				texture.height / (2.0f * chroma[0].height));
+		const GLfloat *c = compositor->get_yuv_coefficients(tex_height);
+		gl.uniform4f(sh->yuvcoef_uniform, c[0], c[1], c[2], c[3]);
+	}
+	gl.active_texture(GL_TEXTURE0);
+	gl.bind_texture(texture.id);
+	set_filter(src_w, src_h, w * scale, h * scale);
+	gl.uniform1i(sh->tex_uniforms[0], 0);
+	gl.uniform2f(sh->texoffset_uniform,
+			src_x / texture.width, src_y / texture.height);
+	gl.uniform2f(sh->texscale_uniform,
+			src_w / texture.width, src_h / texture.height);
+
+	// wl_shm alpha is premultiplied; opaque formats, and everything
+	// while the governor treats it so, write over what is below
+	bool blend = !is_opaque() && !compositor->get_governor().opaque_only();
+	gl.set_blend(blend);
+	if (blend) {
+		gl.blend_func(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+	}
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, texture);
-	glUniform1i(uniform_tex, 0);
+	// attribute 0 is the only one in use, it stays enabled
+	gl.vertex_attrib_pointer(0, 2, verts);
+	gl.enable_vertex_attrib_array(0);
 
+	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+	gl.count_call();
+	compositor->get_metrics().add_draw_call();
+	if (preview == void_grab::PREVIEW_PAD) {
+		glDisable(GL_SCISSOR_TEST);
+	}
 
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, &verts);
-	glEnableVertexAttribArray(0);
+	GL_CHECK_ERROR();
 
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+	uint64_t ns = void_metrics::now() - start;
+	uint64_t pixels = (uint64_t)w * h * scale * scale;
+	cost.add_draw(ns, pixels);
+	client->get_cost().add_draw(ns, pixels);
+}
 
-	glDisableVertexAttribArray(0);
+/*
+ * Render thread, with the texture bound: nearest while each texel lands
+ * on a pixel, linear when scaled. Shrunk to half or less, e.g. a 2x
+ * buffer on a 1x output, linear alone skips texels and shimmers, so
+ * the mipmaps are built once per upload and sampled instead.
+ */
+void void_surface::set_filter(GLfloat src_w, GLfloat src_h, int32_t dst_w,
+		int32_t dst_h) {
+	gl_state &gl = compositor->get_gl_state();
+	GLenum min = GL_NEAREST;
+	if (src_w != dst_w || src_h != dst_h) {
+		min = GL_LINEAR;
+		if ((dst_w * 2 <= src_w || dst_h * 2 <= src_h) &&
+				compositor->get_mipmap_downscale() &&
+				gl.can_mipmap(texture.width, texture.height)) {
+			min = GL_LINEAR_MIPMAP_LINEAR;
+		}
+	}
+	if (texture.filter != min) {
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
+				min == GL_NEAREST ? GL_NEAREST : GL_LINEAR);
+		gl.count_call(2);
+		texture.filter = min;
+	}
+	if (min == GL_LINEAR_MIPMAP_LINEAR && !texture.mipmapped) {
+		glGenerateMipmap(GL_TEXTURE_2D);
+		gl.count_call();
+		texture.mipmapped = true;
+	}
+}
 
-	gl_print_error();
+void void_surface::upload(shm_buffer_t &buf) {
+	TRACE_SCOPE("upload");
+	uint64_t start = void_metrics::now();
+	void_texture_pool &pool = compositor->get_texture_pool();
+	void_uploader &uploader = compositor->get_uploader();
+	int32_t w = buf.get_width();
+	int32_t h = buf.get_height();
+
+	void_format fmt;
+	if (!fmt.describe(buf.get_format(), w, h, buf.get_stride())) {
+		log_warn(LOG_RENDER, "surface(%u): unsupported format %#x",
+				resource.get_id(), (uint32_t)buf.get_format());
+		return;
+	}
+	if (fmt.plane_count > 1 || fmt.planes[0].type != GL_UNSIGNED_BYTE) {
+		upload_planes(buf, fmt, start);
+		return;
+	}
 
-	return;
+	// big buffers go to the upload thread, as long as there is
+	// a previous texture to show in the meantime
+	if (texture.id && uploader.is_available() &&
+			(int64_t)w * h * 4 >= compositor->get_async_threshold()) {
+		back_texture = pool.acquire(w, h);
+		// the storage must reach the driver before the other context
+		// writes into it
+		glFlush();
+		back_width = w;
+		back_height = h;
+		back_shader = fmt.shader;
+		client->add_texture(back_texture.get_bytes());
+
+		upload_job = new void_upload_job();
+		upload_job->texture = back_texture.id;
+		upload_job->width = w;
+		upload_job->height = h;
+		stage_pixels(buf, upload_job->pixels);
+		uploader.submit(upload_job);
+		compositor->get_metrics().add_upload((uint64_t)w * h * 4);
+		return;
+	}
 
-	//// position:
-	//glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, verts);
-	//glEnableVertexAttribArray(0);
+	if (!pool.fits(texture, w, h) || chroma[0].id) {
+		// storage comes from the pool by size class, resizing
+		// within a class only changes the uploaded sub-rectangle
+		release_texture();
+		texture = pool.acquire(w, h);
+		texture_link = compositor->get_texture_budget().add(this,
+				texture.get_bytes());
+		client->add_texture(texture.get_bytes());
+	}
+	compositor->get_gl_state().bind_texture(texture.id);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h,
+			GL_RGBA, GL_UNSIGNED_BYTE,
+			buf.get_data());
+	compositor->get_gl_state().count_call();
+	texture.mipmapped = false;
+	compositor->get_metrics().add_upload((uint64_t)w * h * 4);
+	add_upload_cost((uint64_t)w * h * 4, void_metrics::now() - start);
+	tex_width = w;
+	tex_height = h;
+	tex_shader = fmt.shader;
+}
 
-	//// texcoord:
-	//glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, verts);
-	//glEnableVertexAttribArray(1);
+/*
+ * Render thread: copies the buffer into memory the upload thread owns,
+ * packed rows. The client may release, redraw or destroy the buffer as
+ * soon as this returns.
+ */
+void void_surface::stage_pixels(shm_buffer_t &buf,
+		std::vector<uint8_t> &out) {
+	TRACE_SCOPE("stage");
+	int32_t w = buf.get_width();
+	int32_t h = buf.get_height();
+	int32_t stride = buf.get_stride();
+	const uint8_t *src = (const uint8_t *)buf.get_data();
+	out.resize((size_t)w * h * 4);
+	uint8_t *dst = out.data();
+	for (int32_t y = 0; y < h; y++) {
+		memcpy(dst + (size_t)y * w * 4, src + (size_t)y * stride,
+				(size_t)w * 4);
+	}
+}
 
-	//glUseProgram(shader->program);
-	//glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+/*
+ * Render thread: YUV and packed 16 bit buffers go up as they are, one
+ * texture per plane with the GL type of the format, and the shader
+ * converts YUV. Rows are uploaded whole, stride bytes each, since
+ * GLES2 cannot skip the padding; the content width is what gets
+ * sampled. Not handed to the upload thread, its jobs are RGBA bytes.
+ */
+void void_surface::upload_planes(shm_buffer_t &buf, const void_format &fmt,
+		uint64_t start) {
+	void_texture_pool &pool = compositor->get_texture_pool();
+	gl_state &gl = compositor->get_gl_state();
+
+	bool fits = true;
+	for (int i = 0; i < fmt.plane_count; i++) {
+		const void_plane &p = fmt.planes[i];
+		fits = fits && pool.fits(i ? chroma[i - 1] : texture,
+				p.stride / p.texel_size, p.height,
+				p.format, p.type);
+	}
+	if (!fits || (fmt.plane_count < 3 && chroma[1].id)) {
+		release_texture();
+		for (int i = 0; i < fmt.plane_count; i++) {
+			const void_plane &p = fmt.planes[i];
+			void_texture &t = i ? chroma[i - 1] : texture;
+			t = pool.acquire(p.stride / p.texel_size, p.height,
+					p.format, p.type);
+			if (i) {
+				// chroma is upsampled on every draw
+				gl.bind_texture(t.id);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+						GL_LINEAR);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
+						GL_LINEAR);
+				t.filter = GL_LINEAR;
+			}
+		}
+		texture_link = compositor->get_texture_budget().add(this,
+				texture_bytes());
+		client->add_texture(texture_bytes());
+	}
 
-	//gl_print_error();
+	const uint8_t *data = (const uint8_t *)buf.get_data();
+	uint64_t bytes = 0;
+	for (int i = 0; i < fmt.plane_count; i++) {
+		const void_plane &p = fmt.planes[i];
+		void_texture &t = i ? chroma[i - 1] : texture;
+		gl.bind_texture(t.id);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
+				p.stride / p.texel_size, p.height,
+				p.format, p.type, data + p.offset);
+		gl.count_call();
+		t.mipmapped = false;
+		bytes += (uint64_t)p.stride * p.height;
+	}
+	compositor->get_metrics().add_upload(bytes);
+	add_upload_cost(bytes, void_metrics::now() - start);
+	tex_width = buf.get_width();
+	tex_height = buf.get_height();
+	tex_shader = fmt.shader;
+}
 
-	//glDisableVertexAttribArray(1);
-	//glDisableVertexAttribArray(0);
+void void_surface::flip_texture() {
+	add_upload_cost((uint64_t)back_width * back_height * 4,
+			upload_job->duration);
+	compositor->get_uploader().finish(upload_job);
+	upload_job = NULL;
+
+	void_texture_pool &pool = compositor->get_texture_pool();
+	void_texture_budget &budget = compositor->get_texture_budget();
+	client->remove_texture(texture_bytes());
+	budget.remove(texture_link, texture_bytes());
+	pool.release(texture);
+	pool.release(chroma[0]);
+	pool.release(chroma[1]);
+
+	texture = back_texture;
+	back_texture = void_texture();
+	// the upload thread wrote it in the other context, which only
+	// shows here once it is bound again; a recycled id may be what
+	// the shadowed state already has bound
+	compositor->get_gl_state().invalidate();
+	tex_width = back_width;
+	tex_height = back_height;
+	tex_shader = back_shader;
+	texture_link = budget.add(this, texture.get_bytes());
+}
 
+void void_surface::update_view() {
+	if (!pending.buffer) {
+		return;
+	}
+	shm_buffer_t &buf = *pending.buffer;
+	int32_t w, h;
+	get_size(buf, w, h);
+
+	// the attach offset is relative to the previous buffer, apply it once
+	if (subsurface) {
+		// the parent comes first in the stacking order, it is in place
+		void_surface *parent = subsurface->get_parent();
+		if (!parent) {
+			return;
+		}
+		subsurface->translate(pending.sx, pending.sy);
+		view->set_geometry(
+				parent->view->get_left() + subsurface->get_x(),
+				parent->view->get_top() + subsurface->get_y(), w, h);
+	} else {
+		view->set_geometry(view->get_left() + pending.sx,
+				view->get_top() + pending.sy, w, h);
+	}
+	pending.sx = 0;
+	pending.sy = 0;
+}
+
+bool void_surface::is_opaque() {
+	return pending.buffer &&
+		void_format::is_opaque(pending.buffer->get_format());
 }
 
 void void_surface::commit_state() {
@@ -271,12 +948,25 @@ void void_surface::commit_state() {
 
 void void_shell_surface::bind(shell_surface_resource_t surf) {
 	res = surf;
+	surf.on_destroy() = [&]() {
+		// the resize configure closure points at this
+		if (resized) {
+			compositor->get_grab().cancel(resized);
+		}
+		client->unref_object(void_client::OBJ_SHELL_SURFACE);
+		delete this;
+	};
+
 	surf.on_pong() = [&](uint32_t serial) {
-		printf("get pong (%d).\n", serial);
+		log_debug(LOG_SHELL, "get pong (%u).", serial);
 	};
 
 	surf.on_set_title() = [&](std::string title) {
-		cout << "set title: " << title << endl;
+		log_debug(LOG_SHELL, "set title: %s", title.c_str());
+		auto s = (void_surface *)surf_res.get_user_data();
+		if (s) {
+			s->set_title(title);
+		}
 	};
 
 	surf.on_set_toplevel() = [&](void) {
@@ -284,12 +974,45 @@ void void_shell_surface::bind(shell_surface_resource_t surf) {
 
 	surf.on_move() = [&](seat_resource_t seat, uint32_t serial) {
 		surface_grabbing = true;
-		compositor->start_grabbing_surface();
+		auto s = (void_surface *)surf_res.get_user_data();
+		if (s) {
+			compositor->begin_move(s);
+		}
+	};
+
+	surf.on_resize() = [&](seat_resource_t seat, uint32_t serial,
+			shell_surface_resize edges) {
+		auto s = (void_surface *)surf_res.get_user_data();
+		if (!s) {
+			return;
+		}
+		uint32_t e = static_cast<uint32_t>(edges);
+		resized = s;
+		// wl_shell has no acks, the next buffer is the answer
+		compositor->begin_resize(s, e,
+				[this, e](int32_t w, int32_t h, bool resizing) -> uint32_t {
+			res.send_configure(shell_surface_resize(e), w, h);
+			return 0;
+		});
+	};
+}
+
+void void_shell::bind(resource_t res, void *data) {
+	log_debug(LOG_PROTOCOL, "client bind void_shell");
+
+	auto r = new shell_resource_t(res);
+
+	r->on_get_shell_surface() = [&] (shell_surface_resource_t shell_surf, surface_resource_t surf) {
+		auto new_shell_surf = new void_shell_surface(compositor,
+				compositor->get_client(shell_surf.get_client()));
+		new_shell_surf->bind(shell_surf);
+		//void_shell_surface new_shell_surf;
+		new_shell_surf->bind_surface(surf);
 	};
 }
 
 void void_data_device_manager::bind(resource_t res, void *data) {
-	std::cout << "client bind void_data_device_manager" << std::endl;
+	log_debug(LOG_PROTOCOL, "client bind void_data_device_manager");
 
 	auto r = new data_device_manager_resource_t(res);
 
@@ -302,16 +1025,16 @@ void void_data_device_manager::bind(resource_t res, void *data) {
 }
 
 void void_seat::bind(resource_t res, void *data) {
-	std::cout << "client bind void_seat" << std::endl;
+	log_debug(LOG_PROTOCOL, "client bind void_seat");
 	res_list.push_back(res);
 
 	seat_resource_t r(res);
 
 	r.on_get_pointer() = [&](pointer_resource_t res) {
 		//auto p = new pointer_resource_t(res);
-		auto p = new void_pointer(this);
-		p->bind(res);
 		client_t c = res.get_client();
+		auto p = new void_pointer(this, compositor->get_client(c));
+		p->bind(res);
 		void_view *v = compositor->find_view(c);
 		v->bind_pointer(p);
 	};
@@ -327,9 +1050,45 @@ void void_seat::bind(resource_t res, void *data) {
 	r.send_capabilities(caps);
 }
 
+void void_output::bind(resource_t res, void *data) {
+	log_debug(LOG_PROTOCOL, "client bind void_output");
+
+	auto r = new output_resource_t(res);
+	resource_list.push_back(r);
+	r->on_destroy() = [this, r]() {
+		resource_list.remove(r);
+		delete r;
+	};
+
+	// the mode is in physical pixels, the size in mm as if at 96 dpi
+	int32_t scale = compositor->get_scale();
+	int32_t w = compositor->get_width();
+	int32_t h = compositor->get_height();
+	uint64_t period = compositor->get_metrics().get_refresh_period();
+	int32_t refresh = period ? (int32_t)(1000000000000ull / period) : 60000;
+
+	r->send_geometry(0, 0, w * 254 / 960, h * 254 / 960,
+			output_subpixel::unknown, "void", "wayland",
+			output_transform::normal);
+	r->send_mode(output_mode::current | output_mode::preferred,
+			w * scale, h * scale, refresh);
+	if (r->get_version() >= 2) {
+		r->send_scale(scale);
+		r->send_done();
+	}
+}
+
+void void_output::enter(surface_resource_t &surface) {
+	for (auto r : resource_list) {
+		if (r->get_client() == surface.get_client()) {
+			surface.send_enter(*r);
+		}
+	}
+}
+
 bool void_surface::bind_view(void_view *v) {
 	if (view) {
-		cerr << "the surface has already got a view." << endl;
+		log_warn(LOG_SURFACE, "the surface has already got a view.");
 		return false;
 	}
 	view = v;
@@ -345,15 +1104,108 @@ void_compositor::void_compositor(display_server_t disp)
 	seat(disp, this),
 	output(disp, this),
 	xdg_shell(disp, this),
+	subcompositor(disp, this),
+	viewporter(disp, this),
 	session_active(true),
-	focus(NULL), surface_grabbing(false),
-	prev_pnt_x(0), prev_pnt_y(0)
+	focus(NULL),
+	prev_pnt_x(0), prev_pnt_y(0),
+	frame_count(0),
+	client_id_pool(0),
+	inject_serial(0),
+	drawn_opaque_only(false),
+	presented_swap(0),
+	frames_withheld(0)
 {
+	pixman_region32_init(&output_damage);
+
+	// first, everything below reads the clock
+	void_clock::set_simulated(config.get_bool("clock.simulate", false));
+
+	if (void_log::set_level(config.get_string("log.level", "info")) < 0) {
+		log_warn(LOG_CORE, "unknown log.level, keeping info");
+	}
+	if (void_log::set_categories(
+				config.get_string("log.categories", "all")) < 0) {
+		log_warn(LOG_CORE, "unknown name in log.categories, logging all");
+	}
+
+	client_limits.soft = config.get_size("client.soft_limit", 256 << 20);
+	client_limits.hard = config.get_size("client.hard_limit", 1024 << 20);
+	client_limits.throttle_divisor =
+		config.get_int("client.throttle_divisor", 4);
+
+	texture_budget.set_budget(config.get_size("texture.budget", 512 << 20));
+	std::string size_class = config.get_string("texture.size_class", "64");
+	texture_pool.set_granularity(size_class == "pot" ? 0 :
+			atoi(size_class.c_str()));
+	texture_pool.set_free_limit(config.get_size("texture.pool_limit", 64 << 20));
+	texture_pool.set_gl_state(&gl);
+	async_threshold = config.get_size("upload.async_threshold", 1 << 20);
+	skip_unchanged = config.get_bool("upload.skip_unchanged", true);
+	mipmap_downscale =
+		config.get_string("render.downscale_filter", "mipmap") == "mipmap";
+	wrapper.set_scale(config.get_int("output.scale", 0));
+	std::string matrix = config.get_string("yuv.matrix", "auto");
+	yuv_matrix = matrix == "bt601" ? 601 : matrix == "bt709" ? 709 : 0;
+	void_format::advertise(shm);
+	qos.load(config);
+	governor.load_config(config);
+	grab.load_config(config);
+
+	control.register_command("clients",
+			bind_mem_fn(&void_compositor::query_clients, this));
+	control.register_command("textures", [this](const std::string &) {
+		return texture_budget.describe() + texture_pool.describe();
+	});
+	control.register_command("uploads", [this](const std::string &) {
+		return uploader.describe();
+	});
+	control.register_command("top",
+			bind_mem_fn(&void_compositor::query_top, this));
+	control.register_command("latency",
+			bind_mem_fn(&void_compositor::query_latency, this));
+	control.register_command("log", void_log::command);
+	control.register_command("trace", void_trace::command);
+	control.register_command("metrics", [this](const std::string &args) {
+		if (args == "reset") {
+			metrics.reset();
+			return std::string("reset\n");
+		}
+		return metrics.describe_prometheus();
+	});
+	control.register_command("inject",
+			bind_mem_fn(&void_compositor::inject_input, this));
+	control.register_command("clock", void_clock::command);
+	control.register_command("governor",
+			bind_mem_fn(&void_governor::describe, &governor));
+	control.register_command("qos",
+			bind_mem_fn(&void_qos::describe, &qos));
+	control.register_command("grab",
+			bind_mem_fn(&void_grab::describe, &grab));
+	control.register_command("record",
+			bind_mem_fn(&void_recorder::command, &recorder));
+	control.register_command("render", [this](const std::string &) {
+		return "frames " + std::to_string(frame_count) + "\n" +
+			"frames_in_flight " +
+			std::to_string(wrapper.get_frames_in_flight()) + "\n" +
+			"fence_waits " +
+			std::to_string(wrapper.get_fence_waits()) + "\n" +
+			"idle_frames " +
+			std::to_string(wrapper.get_idle_frames()) + "\n" +
+			"frame_callbacks_withheld " +
+			std::to_string(frames_withheld) + "\n" +
+			gl.describe();
+	});
+
 	//new global_t(display, compositor_interface, 4, this, &c_bind);
 	//new global_t(display, shell_interface, 1, this, &c_bind);
 	//new global_t(display, seat_interface, 1, this, &c_bind);
 	//new global_t(display, shm_interface, 1, this, &c_bind);
 
+	int refresh_rate = config.get_int("metrics.refresh_rate", 60);
+	metrics.set_refresh_rate(refresh_rate);
+	void_clock::set_refresh_rate(refresh_rate);
+	wrapper.set_metrics(&metrics);
 	wrapper.set_owner((void *)this);
 	//wrapper.on_frame() = c_frame;
 	//wrapper.register_callback("frame", c_frame);
@@ -364,6 +1216,10 @@ void_compositor::void_compositor(display_server_t disp)
 	//		bind_mem_fn(&void_compositor::quit, this));
 	wrapper.on_frame() =
 		bind_mem_fn(&void_compositor::frame, this);
+	wrapper.on_prepare() =
+		bind_mem_fn(&void_compositor::prepare_frame, this);
+	wrapper.set_max_frames_in_flight(
+			config.get_int("render.max_frames_in_flight", 2));
 	wrapper.on_quit() =
 		bind_mem_fn(&void_compositor::quit, this);
 	wrapper.on_pointer_enter() =
@@ -375,7 +1231,7 @@ void_compositor::void_compositor(display_server_t disp)
 }
 
 void void_compositor::bind(resource_t res, void *data) {
-	std::cout << "client bind void_compositor" << std::endl;
+	log_debug(LOG_PROTOCOL, "client bind void_compositor");
 
 	auto compositor = new compositor_resource_t(res);
 	compositor->on_create_surface() = [&](surface_resource_t surf_res) {
@@ -386,6 +1242,8 @@ void void_compositor::bind(resource_t res, void *data) {
 
 		s->bind(surf_res);
 		s->bind_view(v);
+
+		std::lock_guard<std::mutex> lock(scene_mutex);
 		surface_list.push_back(s);
 
 		view_list.push_back(v);
@@ -393,21 +1251,521 @@ void void_compositor::bind(resource_t res, void *data) {
 	};
 }
 
+/*
+ * wl_shm says nothing about the color space; like most players, HD
+ * sizes are taken as BT.709 and the rest as BT.601, unless yuv.matrix
+ * says otherwise. Limited range, V to red, U and V to green, U to blue.
+ */
+const GLfloat *void_compositor::get_yuv_coefficients(int32_t height) {
+	static const GLfloat bt601[] = {
+		1.59602678f, 0.39176229f, 0.81296764f, 2.01723214f,
+	};
+	static const GLfloat bt709[] = {
+		1.79274107f, 0.21324861f, 0.53290933f, 2.11240179f,
+	};
+	int m = yuv_matrix ? yuv_matrix : height >= 720 ? 709 : 601;
+	return m == 709 ? bt709 : bt601;
+}
+
+/* render thread, while the GPU is busy with the previous frame */
+void void_compositor::prepare_frame() {
+	TRACE_SCOPE("prepare");
+	std::lock_guard<std::mutex> lock(scene_mutex);
+	reap_surfaces();
+	governor.update(metrics.get_last_cpu(), metrics.get_last_interval(),
+			metrics.get_refresh_period());
+
+	{
+		// what was staged last time has just been swapped, unless
+		// the frame was idle and is still to come
+		uint64_t swap = wrapper.get_swap_time();
+		bool swapped = swap != presented_swap;
+		presented_swap = swap;
+		std::lock_guard<std::mutex> lock(client_mutex);
+		for (auto &&c : client_dict) {
+			if (swapped) {
+				c.second->get_latency().present(swap);
+			}
+			c.second->get_latency().stage();
+		}
+	}
+
+	frame_count++;
+	pixman_region32_clear(&output_damage);
+	update_visibility();
+
+	scene.clear();
+	for (auto s : stacking) {
+		s->set_focused(s->get_root() == focus);
+		if (!s->get_view()->is_visible()) {
+			continue;
+		}
+		s->prepare(&output_damage);
+		scene.push_back(s);
+	}
+	// views that went away or changed places leave no damage of
+	// their own
+	if (scene != drawn_scene ||
+			governor.opaque_only() != drawn_opaque_only) {
+		pixman_region32_union_rect(&output_damage, &output_damage,
+				0, 0, get_width(), get_height());
+	}
+	texture_budget.evict(frame_count);
+	texture_pool.trim();
+}
+
+bool void_compositor::frame() {
+	std::lock_guard<std::mutex> lock(scene_mutex);
+
+	// compose windows
+	// for window list
+	bool damaged = pixman_region32_not_empty(&output_damage);
+	if (damaged) {
+		TRACE_SCOPE("draw");
+		for (auto s : scene) {
+			if (s->is_destroyed()) {
+				continue;
+			}
+			s->draw();
+		}
+		gl.end_frame();
+		drawn_scene = scene;
+		drawn_opaque_only = governor.opaque_only();
+	}
+
+	{
+		TRACE_SCOPE("frame callbacks");
+		uint64_t now = void_clock::now();
+		for (auto s : surface_list) {
+			if (!s->wants_frame(now)) {
+				if (s->withhold_frame()) {
+					frames_withheld++;
+				}
+				continue;
+			}
+			if (s->get_client()->frame_allowed(frame_count)) {
+				s->frame_done();
+			}
+		}
+	}
+
+	display.wake_epoll();
+	return damaged;
+}
+
+/* NULL once the client is gone */
+void_client *void_compositor::find_client(client_t c) {
+	std::lock_guard<std::mutex> lock(client_mutex);
+	auto it = client_dict.find(c);
+	return it != client_dict.end() ? it->second : NULL;
+}
+
+void_client *void_compositor::get_client(client_t c) {
+	// before client_mutex, the render thread takes it inside scene_mutex
+	free_gone_clients();
+	std::lock_guard<std::mutex> lock(client_mutex);
+	auto it = client_dict.find(c);
+	if (it != client_dict.end()) {
+		return it->second;
+	}
+
+	auto vc = new void_client(c, ++client_id_pool, client_limits);
+	client_dict[c] = vc;
+	vc->get_client().on_destroy() = [this, c]() {
+		destroy_client(c);
+	};
+	return vc;
+}
+
+void void_compositor::destroy_client(client_t c) {
+	void_client *vc;
+	{
+		std::lock_guard<std::mutex> lock(client_mutex);
+		auto it = client_dict.find(c);
+		if (it == client_dict.end()) {
+			return;
+		}
+		vc = it->second;
+		client_dict.erase(it);
+	}
+	recorder.client_gone(vc->get_id());
+	free_gone_clients();
+
+	// libwayland destroys the client's resources right after this
+	// signal; their handlers take down the surfaces and still use vc
+	std::lock_guard<std::mutex> lock(scene_mutex);
+	view_client_dict.erase(c);
+	gone_clients.push_back(vc);
+}
+
+/*
+ * Dispatch thread: clients that went away before this point are done
+ * with their resources, the render thread can free them.
+ */
+void void_compositor::free_gone_clients() {
+	std::lock_guard<std::mutex> lock(scene_mutex);
+	dead_clients.splice(dead_clients.end(), gone_clients);
+}
+
+void void_compositor::destroy_surface(void_surface *s) {
+	if (s->is_destroyed()) {
+		return;
+	}
+	recorder.surface_gone(s->get_client()->get_id(),
+			s->get_resource().get_id());
+	std::lock_guard<std::mutex> lock(scene_mutex);
+	void_view *v = s->get_view();
+	surface_list.remove(s);
+	view_list.remove(v);
+	for (auto it = view_client_dict.begin(); it != view_client_dict.end(); ) {
+		if (it->second == v) {
+			it = view_client_dict.erase(it);
+		} else {
+			++it;
+		}
+	}
+	if (focus == s) {
+		focus = NULL;
+	}
+	grab.cancel(s);
+	if (s->get_viewport()) {
+		s->get_viewport()->surface_gone();
+		s->set_viewport(NULL);
+	}
+	// its sub-surfaces are unmapped, its own role goes with it
+	for (auto c : s->get_stack()) {
+		if (c != s) {
+			c->get_subsurface()->parent_gone();
+		}
+	}
+	s->get_stack().clear();
+	if (s->get_subsurface()) {
+		detach_subsurface(s);
+		s->get_subsurface()->surface_gone();
+		s->set_subsurface(NULL);
+	}
+	s->get_client()->unref_object(void_client::OBJ_SURFACE);
+	s->set_destroyed();
+	dead_surfaces.push_back(s);
+}
+
+bool void_compositor::add_subsurface(void_surface *s, void_surface *parent) {
+	std::lock_guard<std::mutex> lock(scene_mutex);
+	void_subsurface *old = s->get_subsurface();
+	if (old && old->get_parent()) {
+		return false;
+	}
+	// no cycles
+	for (void_surface *p = parent; p; p = p->get_subsurface() ?
+			p->get_subsurface()->get_parent() : NULL) {
+		if (p == s) {
+			return false;
+		}
+	}
+	if (old) {
+		// its wl_subsurface is gone, only the surface held it
+		old->surface_gone();
+	}
+	s->set_subsurface(new void_subsurface(this, s, parent));
+
+	// new ones go on top of their siblings
+	std::list<void_surface *> &stack = parent->get_stack();
+	if (stack.empty()) {
+		stack.push_back(parent);
+	}
+	stack.push_back(s);
+
+	// the pointer belongs to the window
+	auto it = view_client_dict.find(s->get_resource().get_client());
+	if (it != view_client_dict.end() && it->second == s->get_view()) {
+		it->second = parent->get_root()->get_view();
+	}
+	return true;
+}
+
+/* with scene_mutex held */
+void void_compositor::detach_subsurface(void_surface *s) {
+	void_surface *parent = s->get_subsurface()->get_parent();
+	if (!parent) {
+		return;
+	}
+	std::list<void_surface *> &stack = parent->get_stack();
+	stack.remove(s);
+	if (stack.size() == 1) {
+		stack.clear();
+	}
+	s->get_subsurface()->parent_gone();
+}
+
+void void_compositor::unlink_subsurface(void_surface *s) {
+	std::lock_guard<std::mutex> lock(scene_mutex);
+	detach_subsurface(s);
+}
+
+bool void_compositor::restack_subsurface(void_surface *s,
+		void_surface *sibling, bool above) {
+	std::lock_guard<std::mutex> lock(scene_mutex);
+	std::list<void_surface *> &stack =
+		s->get_subsurface()->get_parent()->get_stack();
+	auto it = std::find(stack.begin(), stack.end(), sibling);
+	if (it == stack.end()) {
+		return false;
+	}
+	stack.remove(s);
+	it = std::find(stack.begin(), stack.end(), sibling);
+	stack.insert(above ? std::next(it) : it, s);
+	return true;
+}
+
+/* render thread, with scene_mutex held */
+void void_compositor::update_visibility() {
+	pixman_region32_t output, covered;
+	pixman_region32_init_rect(&output, 0, 0, get_width(), get_height());
+	pixman_region32_init(&covered);
+
+	// sub-surfaces go right above or below their parents
+	stacking.clear();
+	for (auto s : surface_list) {
+		if (!s->get_subsurface()) {
+			s->collect_stack(stacking);
+		}
+	}
+	for (auto s : stacking) {
+		s->update_view();
+		grab.apply(s);
+	}
+	// stacking is in drawing order, the last one is on top
+	for (auto it = stacking.rbegin(); it != stacking.rend(); ++it) {
+		void_surface *s = *it;
+		s->get_view()->update_visible(&output, &covered,
+				s->is_opaque() || governor.opaque_only());
+		s->get_view()->take_geometry_damage(&output_damage);
+	}
+
+	pixman_region32_fini(&covered);
+	pixman_region32_fini(&output);
+}
+
+/* render thread, with scene_mutex held */
+void void_compositor::reap_surfaces() {
+	for (auto s : dead_surfaces) {
+		s->release_texture();
+		delete s->get_view();
+		delete s;
+	}
+	dead_surfaces.clear();
+
+	for (auto c : dead_clients) {
+		delete c;
+	}
+	dead_clients.clear();
+}
+
+std::string void_compositor::query_clients(const std::string &args) {
+	std::string out = void_client::describe_header();
+	std::lock_guard<std::mutex> lock(client_mutex);
+	for (auto &&c : client_dict) {
+		out += c.second->describe();
+	}
+	return out;
+}
+
+struct top_entry {
+	uint32_t client;
+	uint32_t surface;	/* 0 for the client itself */
+	std::string title;
+	std::string app_id;
+	void_cost_sample cost;
+};
+
+typedef std::map<std::pair<uint32_t, uint32_t>, top_entry> top_sample;
+
+static void format_top_line(std::string &out, const char *indent,
+		const top_entry &e, const void_cost_sample &d, double secs) {
+	char line[512];
+	std::string name = e.app_id;
+	if (!e.title.empty()) {
+		name += (name.empty() ? "\"" : " \"") + e.title + "\"";
+	}
+	snprintf(line, sizeof line,
+			"%s%-*u %8.1f %11.2f %11.2f %11.2f %11.2f  %s\n",
+			indent, 8 - (int)strlen(indent),
+			e.surface ? e.surface : e.client,
+			d.commits / secs,
+			d.upload_bytes / secs / (1 << 20),
+			d.upload_ns / secs / 1e6,
+			d.draw_ns / secs / 1e6,
+			d.draw_pixels / secs / 1e6,
+			name.c_str());
+	out += line;
+}
+
+/* "latency": input to client, to commit and to swap, in ms */
+std::string void_compositor::query_latency(const std::string &args) {
+	std::string out = void_latency::describe_header();
+	std::lock_guard<std::mutex> lock(client_mutex);
+	for (auto &&c : client_dict) {
+		if (c.second->get_latency().get_count() == 0 && args != "all") {
+			continue;
+		}
+		out += c.second->get_latency().describe(c.second->get_id());
+	}
+	return out;
+}
+
+/*
+ * "top [seconds]": clients and their surfaces by the time spent on
+ * their uploads and draws over the sampling period, most expensive
+ * first.
+ */
+std::string void_compositor::query_top(const std::string &args) {
+	double secs = args.empty() ? 1.0 : atof(args.c_str());
+	if (secs < 0.1) {
+		secs = 0.1;
+	} else if (secs > 10) {
+		secs = 10;
+	}
+
+	auto take_sample = [this]() {
+		top_sample s;
+		{
+			std::lock_guard<std::mutex> lock(client_mutex);
+			for (auto &&c : client_dict) {
+				top_entry &e = s[std::make_pair(c.second->get_id(), 0u)];
+				e.client = c.second->get_id();
+				e.surface = 0;
+				e.cost = c.second->get_cost().sample();
+			}
+		}
+		std::lock_guard<std::mutex> lock(scene_mutex);
+		for (auto surf : surface_list) {
+			uint32_t cid = surf->get_client()->get_id();
+			uint32_t sid = surf->get_resource().get_id();
+			top_entry &e = s[std::make_pair(cid, sid)];
+			e.client = cid;
+			e.surface = sid;
+			surf->get_info(e.title, e.app_id);
+			e.cost = surf->get_cost().sample();
+		}
+		return s;
+	};
+
+	uint64_t t0 = void_metrics::now();
+	top_sample before = take_sample();
+	std::this_thread::sleep_for(std::chrono::microseconds((int64_t)(secs * 1e6)));
+	top_sample after = take_sample();
+	secs = (void_metrics::now() - t0) / 1e9;
+
+	// differences, clients and surfaces that came and went count from 0
+	std::map<uint32_t, std::vector<std::pair<top_entry, void_cost_sample>>> surfaces;
+	std::vector<std::pair<top_entry, void_cost_sample>> clients;
+	for (auto &&a : after) {
+		auto b = before.find(a.first);
+		void_cost_sample d = b == before.end() ?
+			a.second.cost : a.second.cost - b->second.cost;
+		if (a.second.surface) {
+			surfaces[a.second.client].push_back(
+					std::make_pair(a.second, d));
+		} else {
+			clients.push_back(std::make_pair(a.second, d));
+		}
+	}
+	auto by_cost = [](const std::pair<top_entry, void_cost_sample> &x,
+			const std::pair<top_entry, void_cost_sample> &y) {
+		return x.second.get_time() > y.second.get_time();
+	};
+	std::sort(clients.begin(), clients.end(), by_cost);
+
+	char header[256];
+	snprintf(header, sizeof header, "%-8s %8s %11s %11s %11s %11s  %s\n",
+			"CLIENT", "COMMIT/s", "UPLOAD MB/s", "UPLOAD ms/s",
+			"DRAW ms/s", "DRAW Mpx/s", "APP");
+	std::string out = header;
+	for (auto &&c : clients) {
+		auto &list = surfaces[c.first.client];
+		std::sort(list.begin(), list.end(), by_cost);
+		// a client goes by the name of its first named surface
+		top_entry named = c.first;
+		for (auto &&s : list) {
+			if (!s.first.app_id.empty()) {
+				named.app_id = s.first.app_id;
+				break;
+			}
+		}
+		format_top_line(out, "", named, c.second, secs);
+		for (auto &&s : list) {
+			format_top_line(out, "  ", s.first, s.second, secs);
+		}
+	}
+	return out;
+}
+
 void void_compositor::pointer_motion(uint32_t time, int32_t x, int32_t y) {
-	//cout << "pointer motion (" << x << ", " << y << ")@"
-	//	<< time << endl;
+	deliver_motion(time, x, y, wrapper.get_input_time());
+}
+
+void void_compositor::pointer_button(uint32_t serial, uint32_t time,
+		uint32_t button, pointer_button_state state,
+		function<void()> parent_handler) {
+	deliver_button(serial, time, button, state, parent_handler,
+			wrapper.get_input_time());
+}
+
+/*
+ * "inject motion|click [count]": synthetic pointer events handled as if
+ * they came from the host, for benchmarks and unattended latency runs.
+ */
+std::string void_compositor::inject_input(const std::string &args) {
+	std::istringstream in(args);
+	std::string kind;
+	int count = 1;
+	in >> kind >> count;
+	if (kind != "motion" && kind != "click") {
+		return "usage: inject motion|click [count]\n";
+	}
+
+	for (int i = 0; i < count; i++) {
+		uint64_t arrival = void_clock::now();
+		uint32_t time = void_clock::now_ms();
+		if (kind == "motion") {
+			// sweep across the output
+			int32_t x = (inject_serial * 7) % get_width();
+			int32_t y = (inject_serial * 3) % get_height();
+			inject_serial++;
+			deliver_motion(time, x, y, arrival);
+		} else {
+			auto ignore = []() {};
+			deliver_button(++inject_serial, time, BTN_LEFT,
+					pointer_button_state::pressed, ignore, arrival);
+			deliver_button(++inject_serial, time, BTN_LEFT,
+					pointer_button_state::released, ignore, arrival);
+		}
+	}
+	return "injected " + std::to_string(count) + "\n";
+}
+
+void void_compositor::deliver_motion(uint32_t time, int32_t x, int32_t y,
+		uint64_t arrival) {
+	TRACE_SCOPE("input motion");
+	log_trace(LOG_INPUT, "pointer motion (%d, %d)@%u", x, y, time);
 	int dx = x - prev_pnt_x;
 	int dy = y - prev_pnt_y;
 	prev_pnt_x = x;
 	prev_pnt_y = y;
-	if (surface_grabbing) {
-		assert(focus);
-		focus->get_view()->move(dx, dy);
-		display.wake_epoll();
+	std::lock_guard<std::mutex> lock(scene_mutex);
+	if (grab.is_active()) {
+		// applied once per frame, however many events come in
+		if (grab.motion(dx, dy)) {
+			display.wake_epoll();
+		}
 		return;
 	}
 	void_view *focus_v = NULL;
 	for (auto &&v : view_list) {
+		// input goes to the window, not to its parts
+		if (v->get_surface()->get_subsurface()) {
+			continue;
+		}
 		if (v->contain_point(x, y)) {
 			focus_v = v;
 			focus = v->get_surface();
@@ -416,24 +1774,25 @@ void void_compositor::pointer_motion(uint32_t time, int32_t x, int32_t y) {
 		}
 	}
 	if (focus_v) {
-		focus_v->notify_motion(time, x, y);
+		focus_v->notify_motion(time, x, y, arrival);
 	}
 }
 
-void void_compositor::pointer_button(uint32_t serial, uint32_t time,
+void void_compositor::deliver_button(uint32_t serial, uint32_t time,
 		uint32_t button, pointer_button_state state,
-		function<void()> parent_handler) {
+		function<void()> parent_handler, uint64_t arrival) {
+	TRACE_SCOPE("input button");
+	std::unique_lock<std::mutex> lock(scene_mutex);
 	if (!focus) {
+		lock.unlock();
 		parent_handler();
 		return;
 	}
-	if (surface_grabbing) {
-		if (state == pointer_button_state::released) {
-			surface_grabbing = false;
-		}
+	if (grab.is_active() && state == pointer_button_state::released) {
+		grab.end();
 	}
 	auto v = focus->get_view();
-	v->notify_button(serial, time, button, state);
+	v->notify_button(serial, time, button, state, arrival);
 	display.wake_epoll();
 }
 
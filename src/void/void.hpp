@@ -32,6 +32,7 @@
 #include <map>
 #include <unordered_map>
 #include <thread>
+#include <mutex>
 
 #include <wayland-util.hpp>
 #include <wayland-shm.hpp>
@@ -43,6 +44,23 @@
 
 #include "wrapper.hpp"
 #include "void_xdg.hpp"
+#include "void_config.hpp"
+#include "void_control.hpp"
+#include "void_client.hpp"
+#include "void_texture.hpp"
+#include "void_upload.hpp"
+#include "gl_state.hpp"
+#include "void_log.hpp"
+#include "void_metrics.hpp"
+#include "void_trace.hpp"
+#include "void_record.hpp"
+#include "void_clock.hpp"
+#include "void_qos.hpp"
+#include "void_governor.hpp"
+#include "void_grab.hpp"
+#include "void_subsurface.hpp"
+#include "void_viewporter.hpp"
+#include "void_format.hpp"
 
 class void_compositor;
 class void_view;
@@ -66,7 +84,20 @@ protected:
 		/* wl_surface.set_input_region */
 		pixman_region32_t input;
 
-		state() : newly_attached(false), buffer(NULL), sx(0), sy(0) {
+		/* wp_viewport: the source rectangle in surface coordinates,
+		 * w < 0 when unset, and the size it is scaled to, 0 when unset */
+		bool new_viewport;
+		double src_x, src_y, src_w, src_h;
+		int32_t dst_w, dst_h;
+
+		/* wl_surface.set_buffer_scale */
+		bool new_scale;
+		int32_t buffer_scale;
+
+		state() : newly_attached(false), buffer(NULL), sx(0), sy(0),
+			new_viewport(false), src_x(-1), src_y(-1), src_w(-1), src_h(-1),
+			dst_w(0), dst_h(0), new_scale(false), buffer_scale(1)
+		{
 			pixman_region32_init(&damage_buffer);
 			pixman_region32_init(&damage_surface);
 			pixman_region32_init(&opaque);
@@ -77,8 +108,12 @@ protected:
 	wayland::surface_resource_t resource;
 
 	void_compositor *compositor;
+	void_client *client;
 	void_view *view;
+	std::mutex frame_mutex;
 	std::queue<wayland::callback_resource_t> frame_queue;
+	/* the oldest queued callback was counted as withheld */
+	bool frame_withheld;
 
 	/** Damage in local coordinates from the client, for tex upload. */
 	pixman_region32_t damage;                                           
@@ -90,9 +125,86 @@ protected:
 
 	state pending;
 	state current;
+	/* a synchronized sub-surface's requests since its commit, and what
+	 * it committed that waits for the parent's commit */
+	state staged;
+	state cached;
+
+	/* the sub-surface role, if it was given one */
+	void_subsurface *subsurface;
+	void_viewport *viewport;
+	/* this surface and its sub-surfaces, bottom to top, or empty
+	 * without any; changed with scene_mutex held */
+	std::list<void_surface *> stack;
 
 	gl_shader *shader;
 
+	/* retained texture, owned by the render thread; the luma plane of
+	 * YUV content, whose chroma planes are in chroma */
+	void_texture texture;
+	void_texture chroma[2];
+	/* size of the content inside the texture storage */
+	int32_t tex_width, tex_height;
+	/* gl_shader_variant that samples the texture */
+	int tex_shader;
+	void_texture_budget::link_t texture_link;
+	uint64_t last_drawn;
+	bool evicted;
+	/* void_clock time of the last frame callback sent and upload */
+	uint64_t last_frame_done;
+	uint64_t last_upload;
+	/* render thread, from the compositor's focus */
+	bool focused;
+	/* follows the app id */
+	std::atomic<const qos_policy *> qos;
+
+	/*
+	 * void_hash of each row of the content in the texture, 0 where it
+	 * is not known, seeded with the buffer layout
+	 */
+	std::vector<uint64_t> row_hashes;
+	uint64_t row_seed;
+	/* commits in a row that changed content */
+	uint32_t changed_streak;
+
+	/* being filled by the upload thread, shown once the job is done */
+	void_texture back_texture;
+	int32_t back_width, back_height;
+	int back_shader;
+	void_upload_job *upload_job;
+
+	bool destroyed;
+	/* wl_surface.enter was sent */
+	bool entered;
+
+	/* charged to the client as well */
+	void_cost cost;
+	/* from the shell, read by the query socket */
+	std::mutex info_mutex;
+	std::string title;
+	std::string app_id;
+
+	/* a buffer was attached since the last commit, at this offset */
+	bool record_attached;
+	int32_t record_x, record_y;
+
+	/* where attach and damage go */
+	state &requests();
+	static void merge_state(state &from, state &to);
+	void commit_children();
+
+	void upload(wayland::shm_buffer_t &buf);
+	void upload_planes(wayland::shm_buffer_t &buf, const void_format &fmt,
+			uint64_t start);
+	static void stage_pixels(wayland::shm_buffer_t &buf,
+			std::vector<uint8_t> &out);
+	int64_t texture_bytes();
+	void set_filter(GLfloat src_w, GLfloat src_h, int32_t dst_w,
+			int32_t dst_h);
+	bool content_changed(wayland::shm_buffer_t &buf);
+	void flip_texture();
+	void record_commit();
+
 public:
 	void_surface(void_compositor *c);
 
@@ -105,9 +217,87 @@ public:
 		return view;
 	}
 
+	void_client *get_client() {
+		return client;
+	}
+
+	void_cost &get_cost() {
+		return cost;
+	}
+	void add_upload_cost(uint64_t bytes, uint64_t ns) {
+		cost.add_upload(bytes, ns);
+		client->get_cost().add_upload(bytes, ns);
+	}
+
+	void set_title(const std::string &t);
+	void set_app_id(const std::string &id);
+	void get_info(std::string &t, std::string &id) {
+		std::lock_guard<std::mutex> lock(info_mutex);
+		t = title;
+		id = app_id;
+	}
+
+	void update_view();
+	bool is_opaque();
+
+	void_viewport *get_viewport() {
+		return viewport;
+	}
+	void set_viewport(void_viewport *v) {
+		viewport = v;
+	}
+	void set_source(double x, double y, double w, double h);
+	void set_destination(int32_t w, int32_t h);
+	/* render thread: the buffer is cropped or scaled */
+	bool is_scaled() {
+		return pending.src_w >= 0 || pending.dst_w > 0;
+	}
+	void get_size(wayland::shm_buffer_t &buf, int32_t &w, int32_t &h);
+	int32_t get_buffer_scale() {
+		return pending.buffer_scale;
+	}
+
+	void_subsurface *get_subsurface() {
+		return subsurface;
+	}
+	void set_subsurface(void_subsurface *s) {
+		subsurface = s;
+	}
+	std::list<void_surface *> &get_stack() {
+		return stack;
+	}
+	void_surface *get_root();
+	/* the parent committed, or the sub-surface became desynchronized */
+	void apply_cached();
+	void flush_cached();
+	/* render thread: this surface and its mapped sub-surfaces in
+	 * drawing order */
+	void collect_stack(std::vector<void_surface *> &out);
+
+	void prepare(pixman_region32_t *output_damage);
 	void draw();
 
+	void set_destroyed() {
+		destroyed = true;
+	}
+	bool is_destroyed() {
+		return destroyed;
+	}
+
 	void frame_done();
+	/* true once per queued callback that is held back */
+	bool withhold_frame();
+	bool wants_frame(uint64_t now);
+	void set_focused(bool f) {
+		focused = f;
+	}
+	qos_priority get_priority();
+
+	void release_texture();
+	void evict_texture();
+	uint64_t get_last_drawn() {
+		return last_drawn;
+	}
 
 	//void notify_motion(int x, int y) {
 	//	
@@ -152,32 +342,37 @@ public:
 class void_pointer {
 private:
 	void_seat *seat;
-	wayland::client_t *client;
+	void_client *client;
 	wayland::pointer_resource_t resource;
 
 	//std::unordered_map<
 
 public:
-	void_pointer(void_seat *seat)
-		: seat(seat)
+	void_pointer(void_seat *seat, void_client *c)
+		: seat(seat), client(c)
 	{
+		client->ref_object(void_client::OBJ_POINTER);
 	}
 	void bind(wayland::pointer_resource_t res) {
 		resource = res;
 
 		res.on_release() = [&]() {
-			cout << "client released pointer." << endl;
+			log_debug(LOG_INPUT, "client released pointer.");
+			client->unref_object(void_client::OBJ_POINTER);
 			delete this;
 		};
 	}
 
-	void notify_motion(uint32_t time, int x, int y) {
+	/* arrival is when the host gave us the event */
+	void notify_motion(uint32_t time, int x, int y, uint64_t arrival) {
 		wayland::fixed_t fx(x), fy(y);
 		resource.send_motion(time, fx, fy);
+		client->get_latency().input(arrival, void_clock::now());
 	}
 	void notify_button(uint32_t serial, uint32_t time, uint32_t button,
-			wayland::pointer_button_state state) {
+			wayland::pointer_button_state state, uint64_t arrival) {
 		resource.send_button(serial, time, button, state);
+		client->get_latency().input(arrival, void_clock::now());
 	}
 
 };
@@ -227,6 +422,10 @@ private:
 	int32_t width, height;
 	void_pointer *pointer;
 	pixman_region32_t bounding_box;
+	/* bounding box as of the last frame */
+	pixman_region32_t prev_box;
+	/* part of the view not covered by opaque views above, output space */
+	pixman_region32_t visible;
 
 public:
 	void_view(void_surface *surf)
@@ -236,6 +435,8 @@ public:
 		pointer(NULL)
    	{
 		pixman_region32_init(&bounding_box);
+		pixman_region32_init(&prev_box);
+		pixman_region32_init(&visible);
 	}
 	void_view(void_surface *surf, int x, int y,
 			int width, int height)
@@ -243,6 +444,13 @@ public:
 		width(width), height(height)
 	{
 		pixman_region32_init_rect(&bounding_box, x, y, width, height);
+		pixman_region32_init(&prev_box);
+		pixman_region32_init(&visible);
+	}
+	~void_view() {
+		pixman_region32_fini(&bounding_box);
+		pixman_region32_fini(&prev_box);
+		pixman_region32_fini(&visible);
 	}
 	void set_geometry(int x, int y, int width, int height) {
 		this->x = x;
@@ -257,6 +465,12 @@ public:
 	int get_top() {
 		return y;
 	}
+	int get_width() {
+		return width;
+	}
+	int get_height() {
+		return height;
+	}
 	void move(int dx, int dy) {
 		x += dx;
 		y += dy;
@@ -266,21 +480,62 @@ public:
 	bool contain_point(int x, int y) {
 		return pixman_region32_contains_point(&bounding_box, x, y, NULL);
 	}
+
+	/* clips to the output and to what is above, then adds
+	 * this view to the region covering the views below */
+	void update_visible(pixman_region32_t *output,
+			pixman_region32_t *covered, bool opaque) {
+		pixman_region32_intersect(&visible, &bounding_box, output);
+		pixman_region32_subtract(&visible, &visible, covered);
+		if (opaque) {
+			pixman_region32_union(covered, covered, &bounding_box);
+		}
+	}
+	bool is_visible() {
+		return pixman_region32_not_empty(&visible);
+	}
+
+	/* the area the view left and the area it moved to */
+	void take_geometry_damage(pixman_region32_t *damage) {
+		if (pixman_region32_equal(&prev_box, &bounding_box)) {
+			return;
+		}
+		pixman_region32_union(damage, damage, &prev_box);
+		pixman_region32_union(damage, damage, &bounding_box);
+		pixman_region32_copy(&prev_box, &bounding_box);
+	}
+
+	/* surface damage in surface coordinates, or the whole view */
+	void add_damage(pixman_region32_t *damage,
+			pixman_region32_t *surface_damage) {
+		pixman_region32_t d;
+		pixman_region32_init(&d);
+		if (surface_damage && pixman_region32_not_empty(surface_damage)) {
+			pixman_region32_copy(&d, surface_damage);
+			pixman_region32_translate(&d, x, y);
+			pixman_region32_intersect(&d, &d, &bounding_box);
+		} else {
+			pixman_region32_copy(&d, &bounding_box);
+		}
+		pixman_region32_intersect(&d, &d, &visible);
+		pixman_region32_union(damage, damage, &d);
+		pixman_region32_fini(&d);
+	}
 	void_surface *get_surface() {
 		return surface;
 	}
-	void notify_motion(uint32_t time, int x, int y) {
+	void notify_motion(uint32_t time, int x, int y, uint64_t arrival) {
 		assert(pointer);
-		pointer->notify_motion(time, x - this->x, y - this->y);
+		pointer->notify_motion(time, x - this->x, y - this->y, arrival);
 	}
 	void notify_button(uint32_t serial, uint32_t time, uint32_t button,
-			wayland::pointer_button_state state) {
+			wayland::pointer_button_state state, uint64_t arrival) {
 		assert(pointer);
-		pointer->notify_button(serial, time, button, state);
+		pointer->notify_button(serial, time, button, state, arrival);
 	}
 	bool bind_pointer(void_pointer *p) {
 		if (pointer) {
-			cerr << "the view has already got a pointer." << endl;
+			log_warn(LOG_INPUT, "the view has already got a pointer.");
 			return false;
 		}
 		pointer = p;
@@ -297,17 +552,21 @@ protected:
 private:
 	wayland::shell_surface_resource_t res;
 	void_compositor *compositor;
+	void_client *client;
 	wayland::surface_resource_t surf_res;
 	bool surface_grabbing;
+	/* the surface of the last resize, its grab configures through this */
+	void_surface *resized;
 
 public:
 	//void_shell_surface() {
 	//}
 
-	void_shell_surface(void_compositor *c)
-		: compositor(c),
-		surface_grabbing(false)
+	void_shell_surface(void_compositor *c, void_client *cl)
+		: compositor(c), client(cl),
+		surface_grabbing(false), resized(NULL)
 	{
+		client->ref_object(void_client::OBJ_SHELL_SURFACE);
 	}
 
 	void bind(wayland::shell_surface_resource_t surf);
@@ -336,18 +595,7 @@ public:
 	{
 	}
 
-	virtual void bind(wayland::resource_t res, void *data) {
-		std::cout << "client bind void_shell" << std::endl;
-
-		auto r = new wayland::shell_resource_t(res);
-
-		r->on_get_shell_surface() = [&] (wayland::shell_surface_resource_t shell_surf, wayland::surface_resource_t surf) {
-			auto new_shell_surf = new void_shell_surface(compositor);
-			new_shell_surf->bind(shell_surf);
-			//void_shell_surface new_shell_surf;
-			new_shell_surf->bind_surface(surf);
-		};
-	}
+	virtual void bind(wayland::resource_t res, void *data);
 };
 
 class void_pointer;
@@ -386,27 +634,31 @@ class void_output : public wayland::global_t {
 private:
 	wayland::display_server_t display;
 	void_compositor *compositor;
+	/* dispatch thread, for wl_surface.enter */
+	std::list<wayland::output_resource_t *> resource_list;
 
 public:
 	void_output(wayland::display_server_t disp,
 			void_compositor *c)
-		: global_t(disp, wayland::detail::output_interface, 1, this, NULL),
+		: global_t(disp, wayland::detail::output_interface, 2, this, NULL),
 		display(disp),
 		compositor(c)
 	{
 	}
 
-	virtual void bind(wayland::resource_t res, void *data) {
-		std::cout << "client bind void_output" << std::endl;
+	virtual void bind(wayland::resource_t res, void *data);
 
-		auto r = new wayland::output_resource_t(res);
-	}
+	/* tells the surface's client it is on this output */
+	void enter(wayland::surface_resource_t &surface);
 };
 
 class void_compositor : public wayland::global_t {
 private:
 	wayland::display_server_t display;
 
+	void_config config;
+	void_control control;
+
 	display_wrapper_t wrapper;
 
 	wayland::shm_t shm;
@@ -417,6 +669,8 @@ private:
 	void_output output;
 
 	void_zxdg_shell_v6 xdg_shell;
+	void_subcompositor subcompositor;
+	void_viewporter viewporter;
 
 	gl_shader *shader;
 
@@ -450,7 +704,8 @@ private:
 	//struct weston_layer cursor_layer;
 
 	void_surface *focus;
-	bool surface_grabbing;
+	/* interactive move or resize */
+	void_grab grab;
 
 	//previous pointer location
 	int32_t prev_pnt_x;
@@ -463,6 +718,60 @@ private:
 	//struct wl_list view_list;	/* struct weston_view::link */
 	std::list<void_view *> view_list;
 	std::map<wayland::client_t, void_view*> view_client_dict;
+
+	/* guards surface_list and view_list between dispatch and render */
+	std::mutex scene_mutex;
+	/* destroyed by the dispatch thread, freed by the render thread */
+	std::list<void_surface *> dead_surfaces;
+	std::list<void_client *> dead_clients;
+	/* disconnected, their resources may still be being destroyed */
+	std::list<void_client *> gone_clients;
+	uint64_t frame_count;
+
+	std::mutex client_mutex;
+	std::map<wayland::client_t, void_client *> client_dict;
+	uint32_t client_id_pool;
+	void_client::limits_t client_limits;
+	/* serials and positions of injected input */
+	uint32_t inject_serial;
+
+	/* surfaces with their sub-surfaces, bottom to top, of this frame */
+	std::vector<void_surface *> stacking;
+	/* surfaces to draw, built while the previous frame is on the GPU */
+	std::vector<void_surface *> scene;
+	/* what changed on the output since the previous frame, nothing
+	 * is drawn or swapped while it stays empty */
+	pixman_region32_t output_damage;
+	/* what was drawn last, a change of order or of blending repaints */
+	std::vector<void_surface *> drawn_scene;
+	bool drawn_opaque_only;
+	/* swap the staged commits were last presented at */
+	uint64_t presented_swap;
+
+	/* render context state */
+	gl_state gl;
+	void_metrics metrics;
+
+	void_texture_budget texture_budget;
+	void_texture_pool texture_pool;
+
+	void_uploader uploader;
+	int64_t async_threshold;
+	/* skips uploading commits of content already in the texture */
+	bool skip_unchanged;
+	/* mipmaps for surfaces drawn at less than half their size */
+	bool mipmap_downscale;
+	/* 601 or 709, 0 picks by the height of the video */
+	int yuv_matrix;
+
+	void_recorder recorder;
+
+	/* frame and upload rates by focus, app id and visibility */
+	void_qos qos;
+	/* frame callbacks held back for at least a frame, each once */
+	std::atomic<uint64_t> frames_withheld;
+	/* lowers quality while frames run over budget */
+	void_governor governor;
 	//struct wl_list plane_list;
 	//struct wl_list key_binding_list;
 	//struct wl_list modifier_binding_list;
@@ -547,28 +856,22 @@ public:
 		return wrapper.get_height();
 	}
 
-	void frame() {
-		// compose windows
-		// for window list
-		for (auto s : surface_list) {
-			s->draw();
-		}
-
-		for (auto s : surface_list) {
-			s->frame_done();
-		}
-
-		display.wake_epoll();
+	/* physical pixels per logical pixel of the output */
+	int get_scale() {
+		return wrapper.get_scale();
 	}
 
+	void prepare_frame();
+	bool frame();
+
 	void quit() {
-		cout << "quiting..." << endl;
+		log_info(LOG_CORE, "quiting...");
 		running = false;
 		display.terminate();
 	}
 
 	void pointer_enter(int32_t x, int32_t y) {
-		cout << "pointer enters (" << x << ", " << y << ")" << endl;
+		log_debug(LOG_INPUT, "pointer enters (%d, %d)", x, y);
 	}
 
 	void pointer_motion(uint32_t time, int32_t x, int32_t y);
@@ -577,23 +880,122 @@ public:
 			uint32_t button, wayland::pointer_button_state state,
 			function<void()> parent_handler);
 
+	/* arrival is when the event reached us, for latency tracking */
+	void deliver_motion(uint32_t time, int32_t x, int32_t y,
+			uint64_t arrival);
+	void deliver_button(uint32_t serial, uint32_t time,
+			uint32_t button, wayland::pointer_button_state state,
+			function<void()> parent_handler, uint64_t arrival);
+	std::string inject_input(const std::string &args);
+
 	void attach(shared_ptr<wayland::shm_buffer_t> buf) {
 	}
 
-	gl_shader *get_shader() {
-		return shader;
+	/* the variants are initialized together, in an array */
+	gl_shader *get_shader(int variant = SHADER_RGBA) {
+		return shader + variant;
 	}
+	const GLfloat *get_yuv_coefficients(int32_t height);
 
 	void_view *find_view(wayland::client_t c) {
 		return view_client_dict[c];
 	}
 
-	void start_grabbing_surface() {
-		surface_grabbing = true;
+	void_config &get_config() {
+		return config;
+	}
+
+	gl_state &get_gl_state() {
+		return gl;
+	}
+
+	void_metrics &get_metrics() {
+		return metrics;
+	}
+
+	void_texture_budget &get_texture_budget() {
+		return texture_budget;
+	}
+
+	void_texture_pool &get_texture_pool() {
+		return texture_pool;
+	}
+
+	void_uploader &get_uploader() {
+		return uploader;
+	}
+
+	void_qos &get_qos() {
+		return qos;
+	}
+
+	void_governor &get_governor() {
+		return governor;
+	}
+
+	void_recorder &get_recorder() {
+		return recorder;
+	}
+
+	int64_t get_async_threshold() {
+		return async_threshold;
+	}
+	bool get_skip_unchanged() {
+		return skip_unchanged;
+	}
+	bool get_mipmap_downscale() {
+		return mipmap_downscale;
+	}
+
+	uint64_t get_frame_count() {
+		return frame_count;
+	}
+
+	void_client *get_client(wayland::client_t c);
+	void_client *find_client(wayland::client_t c);
+	void destroy_client(wayland::client_t c);
+	void free_gone_clients();
+	void destroy_surface(void_surface *s);
+	void reap_surfaces();
+	void detach_subsurface(void_surface *s);
+	void update_visibility();
+	std::string query_clients(const std::string &args);
+	std::string query_top(const std::string &args);
+	std::string query_latency(const std::string &args);
+
+	/* dispatch thread, the sub-surface tree */
+	bool add_subsurface(void_surface *s, void_surface *parent);
+	void unlink_subsurface(void_surface *s);
+	bool restack_subsurface(void_surface *s, void_surface *sibling,
+			bool above);
+
+	/* dispatch thread, from the shells */
+	void begin_move(void_surface *s) {
+		std::lock_guard<std::mutex> lock(scene_mutex);
+		grab.begin_move(s);
+	}
+	void begin_resize(void_surface *s, uint32_t edges,
+			void_grab::configure_fn f) {
+		std::lock_guard<std::mutex> lock(scene_mutex);
+		grab.begin_resize(s, edges, f);
+	}
+	void_grab &get_grab() {
+		return grab;
+	}
+	void_output &get_output() {
+		return output;
+	}
+	uint32_t next_serial() {
+		return display.next_serial();
 	}
 
 	void run() {
 		running = true;
+		void_log::start(config.get_string("log.file"));
+		void_trace::init(config.get_string("trace.file",
+					"/tmp/void-trace.json"));
+		void_trace::enable(config.get_bool("trace.enabled", false));
+		void_trace::set_thread_name("dispatch");
 		//while (running) {
 		//	display.dispatch();
 		//	wrapper.dispatch();
@@ -604,10 +1006,30 @@ public:
 		wrapper.start();
 
 		shader = wrapper.get_shader();
+		if (config.get_bool("upload.async", true)) {
+			uploader.start(&wrapper);
+		}
+
+		std::string ctl = config.get_string("control.socket");
+		if (ctl.empty()) {
+			const char *dir = getenv("XDG_RUNTIME_DIR");
+			ctl = std::string(dir ? dir : "/tmp") + "/void-control";
+		}
+		control.start(ctl);
+
+		std::string record = config.get_string("record.file");
+		if (!record.empty()) {
+			recorder.start(record);
+		}
 
 		display.run();
+		control.stop();
+		recorder.stop();
+		uploader.stop();
 		wrapper.stop();
 		wrapper.join();
+		void_trace::shutdown();
+		void_log::stop();
 	}
 };
 
@@ -6,13 +6,42 @@ include $(PROJDIR)rules.mk
 
 #TARGET = void
 
-LIBS = wayland-server++ pixman-1 input dl EGL wayland-client++ wayland-egl++ wayland-cursor++ wayland-shm++ xdg_shell_unstable_v6-server++ GLESv2 wayland-server
+LIBS = wayland-server++ pixman-1 input dl EGL wayland-client++ wayland-egl++ wayland-cursor++ wayland-shm++ xdg_shell_unstable_v6-server++ viewporter-server++ GLESv2 wayland-server z
 
 LDFLAGS += -Wl,-E
 
+# make GL_DEBUG=1 checks glGetError() after every draw
+ifdef GL_DEBUG
+MACROS += -DVOID_GL_DEBUG
+endif
+
+# make LOG_LEVEL=debug (or trace) compiles in the lower log levels
+ifdef LOG_LEVEL
+MACROS += -DVOID_LOG_LEVEL=LOG_$(shell echo $(LOG_LEVEL) | tr a-z A-Z)
+endif
+
 SRCS = \
 	   void.cpp \
 	   void_xdg.cpp \
+	   void_client.cpp \
+	   void_config.cpp \
+	   void_control.cpp \
+	   void_texture.cpp \
+	   void_upload.cpp \
+	   gl_state.cpp \
+	   void_log.cpp \
+	   void_metrics.cpp \
+	   void_trace.cpp \
+	   void_latency.cpp \
+	   void_record.cpp \
+	   void_hash.cpp \
+	   void_clock.cpp \
+	   void_qos.cpp \
+	   void_governor.cpp \
+	   void_grab.cpp \
+	   void_subsurface.cpp \
+	   void_viewporter.cpp \
+	   void_format.cpp \
 	   wrapper.cpp \
 
 
@@ -20,10 +49,51 @@ SRCS = \
 
 $(eval $(call make_executable,void,$(SRCS),$(LIBS)))
 
+# flashes on click, for measuring input latency
+PROBE_SRCS = void_probe.cpp void_shm.cpp
+PROBE_LIBS = wayland-client++
+
+$(eval $(call make_executable,void_probe,$(PROBE_SRCS),$(PROBE_LIBS)))
+
+# plays back what the "record" control command captured
+REPLAY_SRCS = void_replay.cpp void_shm.cpp
+REPLAY_LIBS = wayland-client++ z
+
+$(eval $(call make_executable,void_replay,$(REPLAY_SRCS),$(REPLAY_LIBS)))
+
+# synthetic clients and the runner for make bench
+BENCH_CLIENT_SRCS = void_bench_client.cpp void_shm.cpp
+BENCH_CLIENT_LIBS = wayland-client++
+BENCH_SRCS = void_bench.cpp
+BENCH_COMPARE_SRCS = void_bench_compare.cpp
+
+$(eval $(call make_executable,void_bench_client,$(BENCH_CLIENT_SRCS),$(BENCH_CLIENT_LIBS)))
+$(eval $(call make_executable,void_bench,$(BENCH_SRCS),))
+$(eval $(call make_executable,void_bench_compare,$(BENCH_COMPARE_SRCS),))
+
 $(eval $(call print_vars,ALL_TARGETS))
 
 all: $$(ALL_TARGETS)
 
+# make bench BENCH_ARGS="-d 30 -s animate,input -o bench.json"
+.PHONY: bench bench-baseline bench-check
+
+BENCH_BINS = $(BINDIR)void $(BINDIR)void_bench $(BINDIR)void_bench_client \
+			 $(BINDIR)void_bench_compare
+BENCH_DIR ?= $(BUILDDIR)bench/
+BENCH_RUNS ?= 5
+
+bench: $(BENCH_BINS)
+	$(BINDIR)void_bench -b $(BINDIR) $(BENCH_ARGS)
+
+# baselines are per scenario in $(BENCH_DIR), bench-check fails on regressions
+bench-baseline bench-check: $(BENCH_BINS)
+	@mkdir -p $(BENCH_DIR)
+	$(BINDIR)void_bench -b $(BINDIR) -r $(BENCH_RUNS) \
+		-o $(BENCH_DIR)last-run.jsonl $(BENCH_ARGS)
+	$(BINDIR)void_bench_compare $(if $(filter bench-baseline,$@),-u) \
+		$(BENCH_COMPARE_ARGS) $(BENCH_DIR) $(BENCH_DIR)last-run.jsonl
+
 
 
 
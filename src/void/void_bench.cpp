@@ -0,0 +1,478 @@
+/* void_bench.cpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Benchmark runner.
+ *
+ * Runs each scenario against a fresh compositor nested in a headless
+ * host compositor, and prints one JSON object per scenario run:
+ * frames per second, frame interval, CPU and GPU time per frame
+ * percentiles, CPU time and RSS of the compositor, commits skipped as
+ * unchanged, and input latency. A scenario whose clients repeat their
+ * content fails if none of those commits were skipped.
+ *
+ * usage: void_bench [-d seconds] [-w warmup] [-r runs] [-s a,b,...]
+ *		[-o file] [-b bindir]
+ *
+ * The host is started with $VOID_BENCH_HOST, by default a headless
+ * weston; the compositor needs EGL on it.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#define DEFAULT_HOST "weston --backend=headless-backend.so " \
+	"--width=800 --height=600 --socket=wayland-0 --idle-time=0"
+
+struct scenario {
+	const char *name;
+	/* void_bench_client arguments, one process each */
+	std::vector<std::vector<std::string>> clients;
+	/* sent to the "inject" command over and over while measuring */
+	const char *inject;
+	/* the clients commit the same content over and over, the
+	 * compositor must skip uploading it */
+	bool unchanged;
+};
+
+static const std::vector<scenario> scenarios = {
+	{ "animate", { { "animate", "4" } }, NULL, false },
+	{ "terminal", { { "terminal", "32" } }, NULL, false },
+	{ "resize", { { "resize", "4" } }, NULL, false },
+	{ "churn", { { "churn" } }, NULL, false },
+	{ "input", { { "input", "1" } }, "motion 20", false },
+	{ "blink", { { "blink", "4" } }, NULL, true },
+};
+
+typedef std::map<std::string, std::string> env_t;
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static pid_t spawn(const std::vector<std::string> &args, const env_t &env) {
+	pid_t pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return -1;
+	}
+	if (pid > 0) {
+		return pid;
+	}
+
+	for (auto &&e : env) {
+		setenv(e.first.c_str(), e.second.c_str(), 1);
+	}
+	std::vector<char *> argv;
+	for (auto &&a : args) {
+		argv.push_back((char *)a.c_str());
+	}
+	argv.push_back(NULL);
+	execvp(argv[0], argv.data());
+	fprintf(stderr, "%s: %s\n", argv[0], strerror(errno));
+	_exit(127);
+}
+
+static bool alive(pid_t pid) {
+	return waitpid(pid, NULL, WNOHANG) == 0;
+}
+
+static void terminate(pid_t pid) {
+	if (pid <= 0) {
+		return;
+	}
+	kill(pid, SIGTERM);
+	for (int i = 0; i < 100; i++) {
+		if (waitpid(pid, NULL, WNOHANG) != 0) {
+			return;
+		}
+		usleep(20000);
+	}
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+}
+
+/* one request line, the whole answer */
+static int query(const std::string &path, const std::string &line,
+		std::string &out) {
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		return -1;
+	}
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path.c_str(), sizeof addr.sun_path - 1);
+	if (connect(fd, (sockaddr *)&addr, sizeof addr) < 0) {
+		close(fd);
+		return -1;
+	}
+	std::string req = line + "\n";
+	if (write(fd, req.data(), req.size()) != (ssize_t)req.size()) {
+		close(fd);
+		return -1;
+	}
+	out.clear();
+	char buf[4096];
+	ssize_t n;
+	while ((n = read(fd, buf, sizeof buf)) > 0) {
+		out.append(buf, n);
+	}
+	close(fd);
+	return 0;
+}
+
+static bool wait_for(const std::function<bool()> &ready, pid_t pid,
+		double timeout) {
+	double end = now() + timeout;
+	while (now() < end) {
+		if (ready()) {
+			return true;
+		}
+		if (!alive(pid)) {
+			return false;
+		}
+		usleep(50000);
+	}
+	return false;
+}
+
+/* utime + stime in seconds */
+static double proc_cpu(pid_t pid) {
+	char path[64];
+	snprintf(path, sizeof path, "/proc/%d/stat", pid);
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		return 0;
+	}
+	char buf[1024];
+	size_t n = fread(buf, 1, sizeof buf - 1, f);
+	fclose(f);
+	buf[n] = '\0';
+	// fields after the command name, which may contain spaces
+	char *p = strrchr(buf, ')');
+	if (!p) {
+		return 0;
+	}
+	unsigned long utime = 0, stime = 0;
+	sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+			&utime, &stime);
+	return (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+/* a "Vm...:" line of /proc/<pid>/status, in kB */
+static long proc_status(pid_t pid, const char *key) {
+	char path[64];
+	snprintf(path, sizeof path, "/proc/%d/status", pid);
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		return 0;
+	}
+	char line[256];
+	long value = 0;
+	size_t len = strlen(key);
+	while (fgets(line, sizeof line, f)) {
+		if (strncmp(line, key, len) == 0 && line[len] == ':') {
+			value = atol(line + len + 1);
+			break;
+		}
+	}
+	fclose(f);
+	return value;
+}
+
+/* "name value" and "name{quantile="q"} value" lines */
+static std::map<std::string, double> parse_metrics(const std::string &text) {
+	std::map<std::string, double> m;
+	std::istringstream in(text);
+	std::string line;
+	while (std::getline(in, line)) {
+		if (line.empty() || line[0] == '#') {
+			continue;
+		}
+		size_t sp = line.rfind(' ');
+		if (sp == std::string::npos) {
+			continue;
+		}
+		m[line.substr(0, sp)] = atof(line.c_str() + sp + 1);
+	}
+	return m;
+}
+
+/* percentiles in ms of a summary exported in seconds */
+static std::string json_quantiles(std::map<std::string, double> &m,
+		const std::string &name) {
+	static const char *qs[][2] = {
+		{ "0.5", "p50" }, { "0.9", "p90" },
+		{ "0.99", "p99" }, { "0.999", "p999" },
+	};
+	std::string out = "{";
+	char buf[64];
+	for (auto &&q : qs) {
+		snprintf(buf, sizeof buf, "%s\"%s\":%.3f", out.size() > 1 ? "," : "",
+				q[1], m[name + "{quantile=\"" + q[0] + "\"}"] * 1e3);
+		out += buf;
+	}
+	return out + "}";
+}
+
+/* the busiest client's row of the "latency" table */
+static std::string json_latency(const std::string &text) {
+	std::istringstream in(text);
+	std::string line;
+	std::getline(in, line);
+	double best[9] = { 0 };
+	while (std::getline(in, line)) {
+		double v[9] = { 0 };
+		std::istringstream row(line);
+		for (auto &&x : v) {
+			row >> x;
+		}
+		if (v[1] > best[1]) {
+			memcpy(best, v, sizeof best);
+		}
+	}
+	char buf[256];
+	snprintf(buf, sizeof buf,
+			"{\"events\":%.0f,\"send_p50\":%.3f,\"commit_p50\":%.3f,"
+			"\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f}",
+			best[1], best[2], best[3],
+			best[5], best[6], best[7], best[8]);
+	return buf;
+}
+
+/* sum of one column of the "clients" table */
+static double sum_column(const std::string &text, const std::string &name) {
+	std::istringstream in(text);
+	std::string line, word;
+	std::getline(in, line);
+	std::istringstream header(line);
+	int col = 0;
+	while (header >> word && word != name) {
+		col++;
+	}
+	double sum = 0;
+	while (std::getline(in, line)) {
+		std::istringstream row(line);
+		for (int i = 0; i <= col && row >> word; i++) {
+			if (i == col) {
+				sum += atof(word.c_str());
+			}
+		}
+	}
+	return sum;
+}
+
+static void remove_dir(const std::string &dir) {
+	std::string cmd = "rm -rf '" + dir + "'";
+	if (system(cmd.c_str()) != 0) {
+		fprintf(stderr, "could not remove %s\n", dir.c_str());
+	}
+}
+
+static int run_scenario(const scenario &s, int run, const std::string &bindir,
+		double warmup, double duration, FILE *out) {
+	char tmpl[] = "/tmp/void-bench-XXXXXX";
+	if (!mkdtemp(tmpl)) {
+		perror("mkdtemp");
+		return -1;
+	}
+	std::string dir = tmpl;
+	std::string control = dir + "/void-control";
+	const char *host_cmd = getenv("VOID_BENCH_HOST");
+
+	env_t env;
+	env["XDG_RUNTIME_DIR"] = dir;
+	pid_t host = spawn({ "/bin/sh", "-c", host_cmd ? host_cmd : DEFAULT_HOST },
+			env);
+	std::vector<pid_t> clients;
+	pid_t comp = -1;
+	int ret = -1;
+	std::string metrics, latency, client_table;
+	double wasted;
+	double cpu0, cpu1, t0, t1;
+	long rss, hwm;
+
+	std::string host_socket = dir + "/wayland-0";
+	if (!wait_for([&]() {
+				struct stat st;
+				return stat(host_socket.c_str(), &st) == 0;
+			}, host, 10)) {
+		fprintf(stderr, "%s: host compositor did not come up\n", s.name);
+		goto out;
+	}
+
+	env["WAYLAND_DISPLAY"] = "void-bench";
+	env["VOID_CONFIG"] = "/dev/null";
+	env["VOID_CONTROL_SOCKET"] = control;
+	comp = spawn({ bindir + "/void" }, env);
+	if (!wait_for([&]() {
+				std::string r;
+				return query(control, "render", r) == 0;
+			}, comp, 10)) {
+		fprintf(stderr, "%s: compositor did not come up\n", s.name);
+		goto out;
+	}
+
+	for (auto &&args : s.clients) {
+		std::vector<std::string> argv = { bindir + "/void_bench_client" };
+		argv.insert(argv.end(), args.begin(), args.end());
+		clients.push_back(spawn(argv, env));
+	}
+
+	usleep(warmup * 1e6);
+	query(control, "metrics reset", metrics);
+	cpu0 = proc_cpu(comp);
+	t0 = now();
+	while (now() - t0 < duration) {
+		if (s.inject) {
+			std::string r;
+			query(control, std::string("inject ") + s.inject, r);
+			usleep(5000);
+		} else {
+			usleep(100000);
+		}
+		if (!alive(comp)) {
+			fprintf(stderr, "%s: compositor died\n", s.name);
+			goto out;
+		}
+	}
+	t1 = now();
+	cpu1 = proc_cpu(comp);
+	query(control, "metrics", metrics);
+	query(control, "latency", latency);
+	query(control, "clients", client_table);
+	wasted = sum_column(client_table, "WASTED");
+	rss = proc_status(comp, "VmRSS");
+	hwm = proc_status(comp, "VmHWM");
+
+	{
+		auto m = parse_metrics(metrics);
+		double secs = t1 - t0;
+		fprintf(out, "{\"scenario\":\"%s\",\"run\":%d,"
+				"\"duration_s\":%.3f,\"frames\":%.0f,\"fps\":%.2f,"
+				"\"dropped_frames\":%.0f,"
+				"\"frame_interval_ms\":%s,\"frame_cpu_ms\":%s,"
+				"\"frame_gpu_ms\":%s,"
+				"\"cpu_s\":%.3f,\"cpu_percent\":%.2f,"
+				"\"rss_kb\":%ld,\"rss_peak_kb\":%ld,"
+				"\"upload_mb_s\":%.3f,\"wasted_commits\":%.0f,"
+				"\"latency_ms\":%s}\n",
+				s.name, run, secs,
+				m["void_frames_total"],
+				m["void_frames_total"] / secs,
+				m["void_frames_dropped_total"],
+				json_quantiles(m, "void_frame_interval_seconds").c_str(),
+				json_quantiles(m, "void_frame_cpu_seconds").c_str(),
+				json_quantiles(m, "void_frame_gpu_seconds").c_str(),
+				cpu1 - cpu0, (cpu1 - cpu0) / secs * 100,
+				rss, hwm,
+				m["void_upload_bytes_total"] / secs / (1 << 20),
+				wasted,
+				json_latency(latency).c_str());
+		fflush(out);
+	}
+	// e.g. a hash over rows the upload has since changed in place
+	if (s.unchanged && wasted == 0) {
+		fprintf(stderr, "%s: unchanged commits were uploaded again\n",
+				s.name);
+		goto out;
+	}
+	ret = 0;
+
+out:
+	for (auto pid : clients) {
+		terminate(pid);
+	}
+	terminate(comp);
+	terminate(host);
+	remove_dir(dir);
+	return ret;
+}
+
+int main(int argc, char *argv[]) {
+	double duration = 10, warmup = 2;
+	int runs = 1;
+	std::string only, output;
+	std::string bindir = dirname(strdup(argv[0]));
+
+	int opt;
+	while ((opt = getopt(argc, argv, "d:w:r:s:o:b:")) != -1) {
+		switch (opt) {
+		case 'd': duration = atof(optarg); break;
+		case 'w': warmup = atof(optarg); break;
+		case 'r': runs = atoi(optarg); break;
+		case 's': only = "," + std::string(optarg) + ","; break;
+		case 'o': output = optarg; break;
+		case 'b': bindir = optarg; break;
+		default:
+			fprintf(stderr, "usage: %s [-d seconds] [-w warmup] "
+					"[-r runs] [-s a,b,...] [-o file] [-b bindir]\n",
+					argv[0]);
+			return 1;
+		}
+	}
+
+	FILE *out = stdout;
+	if (!output.empty() && !(out = fopen(output.c_str(), "w"))) {
+		perror(output.c_str());
+		return 1;
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	int failed = 0;
+	for (auto &&s : scenarios) {
+		if (!only.empty() &&
+				only.find("," + std::string(s.name) + ",") == std::string::npos) {
+			continue;
+		}
+		for (int r = 0; r < runs; r++) {
+			if (run_scenario(s, r, bindir, warmup, duration, out) < 0) {
+				failed++;
+			}
+		}
+	}
+	if (out != stdout) {
+		fclose(out);
+	}
+	return failed ? 1 : 0;
+}
+
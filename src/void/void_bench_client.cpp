@@ -0,0 +1,352 @@
+/* void_bench_client.cpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Synthetic clients for the benchmark runner.
+ *
+ * usage: void_bench_client <mode> [count]
+ *
+ *	animate		count windows repainting all of their content every frame
+ *	terminal	count small windows damaging a single text row per frame
+ *	resize		count windows changing their size every frame
+ *	churn		windows created and destroyed as fast as possible
+ *	input		a window damaging a cursor sized square where the pointer
+ *			moves, driven by "inject motion" on the control socket
+ *	blink		count translucent argb8888 windows redrawing the same
+ *			content every frame, like a blinking caret that is
+ *			repainted on its timer whether or not it changed
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <list>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <wayland-util.hpp>
+#include <wayland-client.hpp>
+
+#include "void_shm.hpp"
+
+using namespace wayland;
+
+/* the size of the compositor output */
+#define SCREEN_WIDTH 800
+#define SCREEN_HEIGHT 600
+
+struct bench_globals {
+	display_client_t display;
+	registry_proxy_t registry;
+	compositor_proxy_t compositor;
+	shell_proxy_t shell;
+	seat_proxy_t seat;
+	shm_proxy_t shm;
+	pointer_proxy_t pointer;
+
+	bench_globals() {
+		registry = display.get_registry();
+		registry.on_global() = [&](uint32_t name, std::string interface,
+				uint32_t version) {
+			if (interface == "wl_compositor")
+				registry.bind(name, compositor, version);
+			else if (interface == "wl_shell")
+				registry.bind(name, shell, version);
+			else if (interface == "wl_seat")
+				registry.bind(name, seat, version);
+			else if (interface == "wl_shm")
+				registry.bind(name, shm, version);
+		};
+		display.roundtrip();
+		if (!compositor || !shell || !shm) {
+			throw std::runtime_error("missing globals");
+		}
+	}
+};
+
+/* shm memory with up to two buffers cut out of it */
+struct bench_pool {
+	shm_pool_proxy_t pool;
+	uint8_t *mem;
+	size_t size;
+
+	bench_pool(bench_globals &g, size_t bytes) : size(bytes) {
+		int fd = void_create_shm_file("void-bench", size);
+		void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+				MAP_SHARED, fd, 0);
+		if (p == MAP_FAILED) {
+			close(fd);
+			throw std::runtime_error("mmap");
+		}
+		mem = (uint8_t *)p;
+		pool = g.shm.create_pool(fd, size);
+		close(fd);
+	}
+
+	~bench_pool() {
+		munmap(mem, size);
+	}
+};
+
+class bench_window {
+public:
+	enum mode_t {
+		ANIMATE,
+		TERMINAL,
+		RESIZE,
+		INPUT,
+		BLINK,
+	};
+
+private:
+	struct slot {
+		buffer_proxy_t buffer;
+		bool busy;
+		int32_t width, height;
+		size_t offset;
+	};
+
+	bench_globals &g;
+	mode_t mode;
+	surface_proxy_t surface;
+	shell_surface_proxy_t shell_surface;
+	callback_proxy_t frame_cb;
+	std::unique_ptr<bench_pool> pool;
+	slot slots[2];
+	int32_t width, height;
+	uint64_t frames;
+
+	/* pointer position and whether it moved since the last frame */
+	int32_t px, py;
+	bool moved;
+
+	slot *get_slot(int32_t w, int32_t h) {
+		for (auto &&s : slots) {
+			if (s.busy) {
+				continue;
+			}
+			if (s.buffer && (s.width != w || s.height != h)) {
+				// dropping the last reference destroys it
+				s.buffer = buffer_proxy_t();
+			}
+			if (!s.buffer) {
+				s.buffer = pool->pool.create_buffer(s.offset, w, h,
+						w * 4, mode == BLINK ? shm_format::argb8888 :
+						shm_format::xrgb8888);
+				s.width = w;
+				s.height = h;
+				slot *p = &s;
+				s.buffer.on_release() = [p]() {
+					p->busy = false;
+				};
+			}
+			return &s;
+		}
+		return NULL;
+	}
+
+	void fill(slot *s, int32_t x, int32_t y, int32_t w, int32_t h,
+			uint32_t color) {
+		uint32_t *pixels = (uint32_t *)(pool->mem + s->offset);
+		for (int32_t row = y; row < y + h && row < s->height; row++) {
+			uint32_t *p = pixels + row * s->width;
+			for (int32_t col = x; col < x + w && col < s->width; col++) {
+				p[col] = color;
+			}
+		}
+	}
+
+	void request_frame() {
+		frame_cb = surface.frame();
+		frame_cb.on_done() = [&](uint32_t) {
+			draw();
+		};
+	}
+
+public:
+	bench_window(bench_globals &globals, mode_t m, int32_t w, int32_t h)
+		: g(globals), mode(m), width(w), height(h), frames(0),
+		px(0), py(0), moved(false)
+	{
+		int32_t max_w = mode == RESIZE ? SCREEN_WIDTH : w;
+		int32_t max_h = mode == RESIZE ? SCREEN_HEIGHT : h;
+		size_t bytes = (size_t)max_w * max_h * 4;
+		pool.reset(new bench_pool(g, bytes * 2));
+		for (int i = 0; i < 2; i++) {
+			slots[i].busy = false;
+			slots[i].width = slots[i].height = 0;
+			slots[i].offset = bytes * i;
+		}
+
+		surface = g.compositor.create_surface();
+		shell_surface = g.shell.get_shell_surface(surface);
+		shell_surface.on_ping() = [&](uint32_t serial) {
+			shell_surface.pong(serial);
+		};
+		shell_surface.set_title("bench");
+		shell_surface.set_toplevel();
+	}
+
+	void motion(int32_t x, int32_t y) {
+		px = x;
+		py = y;
+		moved = true;
+	}
+
+	void draw() {
+		frames++;
+		if (mode == RESIZE) {
+			width = 200 + (frames * 37) % (SCREEN_WIDTH - 200);
+			height = 150 + (frames * 23) % (SCREEN_HEIGHT - 150);
+		}
+		if (mode == INPUT && !moved && frames > 1) {
+			request_frame();
+			surface.commit();
+			return;
+		}
+
+		slot *s = get_slot(width, height);
+		if (!s) {
+			// both buffers still held by the compositor
+			request_frame();
+			surface.commit();
+			return;
+		}
+
+		uint32_t color = 0xff000000 | (uint32_t)(frames * 0x010305);
+		switch (mode) {
+		case ANIMATE:
+		case RESIZE:
+			fill(s, 0, 0, width, height, color);
+			surface.damage(0, 0, width, height);
+			break;
+		case TERMINAL: {
+			// one 12 pixel high line of text changes
+			int32_t row = (frames % (height / 12)) * 12;
+			fill(s, 0, row, width, 12, color);
+			surface.damage(0, row, width, 12);
+			break;
+		}
+		case INPUT:
+			fill(s, px, py, 16, 16, color);
+			surface.damage(px, py, 16, 16);
+			moved = false;
+			break;
+		case BLINK:
+			// both buffers end up with the same pixels
+			fill(s, 0, 0, width, height, 0x80402010);
+			surface.damage(0, 0, width, height);
+			break;
+		}
+
+		s->busy = true;
+		surface.attach(s->buffer, 0, 0);
+		request_frame();
+		surface.commit();
+	}
+};
+
+static void run_churn(bench_globals &g) {
+	bench_pool pool(g, 64 * 64 * 4);
+	memset(pool.mem, 0x80, pool.size);
+	buffer_proxy_t buffer = pool.pool.create_buffer(0, 64, 64, 64 * 4,
+			shm_format::xrgb8888);
+
+	for (uint64_t i = 0; ; i++) {
+		surface_proxy_t surface = g.compositor.create_surface();
+		shell_surface_proxy_t shell_surface =
+			g.shell.get_shell_surface(surface);
+		shell_surface.set_toplevel();
+		surface.attach(buffer, 0, 0);
+		surface.damage(0, 0, 64, 64);
+		surface.commit();
+		// both are destroyed as they go out of scope here;
+		// let the compositor keep up instead of queueing without bound
+		if (i % 16 == 0 && g.display.roundtrip() < 0) {
+			break;
+		}
+	}
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s animate|terminal|resize|churn|input|"
+				"blink [count]\n", argv[0]);
+		return 1;
+	}
+	std::string mode = argv[1];
+	int count = argc > 2 ? atoi(argv[2]) : 1;
+
+	bench_globals g;
+	if (mode == "churn") {
+		run_churn(g);
+		return 0;
+	}
+
+	bench_window::mode_t m;
+	int32_t w = SCREEN_WIDTH, h = SCREEN_HEIGHT;
+	if (mode == "animate") {
+		m = bench_window::ANIMATE;
+	} else if (mode == "terminal") {
+		m = bench_window::TERMINAL;
+		w = 480;
+		h = 288;
+	} else if (mode == "resize") {
+		m = bench_window::RESIZE;
+	} else if (mode == "input") {
+		m = bench_window::INPUT;
+	} else if (mode == "blink") {
+		m = bench_window::BLINK;
+		w = 480;
+		h = 288;
+	} else {
+		fprintf(stderr, "unknown mode %s\n", mode.c_str());
+		return 1;
+	}
+
+	std::list<bench_window> windows;
+	for (int i = 0; i < count; i++) {
+		windows.emplace_back(g, m, w, h);
+	}
+
+	if (m == bench_window::INPUT && g.seat) {
+		g.pointer = g.seat.get_pointer();
+		g.pointer.on_motion() = [&](uint32_t time, fixed_t x, fixed_t y) {
+			windows.front().motion((double)x, (double)y);
+		};
+	}
+
+	for (auto &&win : windows) {
+		win.draw();
+	}
+	while (g.display.dispatch() >= 0) {
+	}
+
+	return 0;
+}
+
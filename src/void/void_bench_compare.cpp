@@ -0,0 +1,325 @@
+/* void_bench_compare.cpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Regression gate for void_bench results.
+ *
+ * Baselines are kept per scenario as <dir>/<scenario>.json, holding the
+ * JSON lines of several runs.  A metric regresses when the 95%
+ * confidence interval of the difference of means (Welch) lies entirely
+ * on the worse side and the mean moved by more than the threshold.
+ *
+ * usage: void_bench_compare [-t percent] <baseline dir> <results>
+ *        void_bench_compare -u <baseline dir> <results>
+ *
+ * Exits 1 if anything regressed, 2 on errors.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+typedef std::map<std::string, double> sample_t;
+typedef std::map<std::string, std::vector<sample_t>> results_t;
+
+struct metric {
+	const char *key;
+	/* +1 when larger is worse */
+	int worse;
+};
+
+static const metric metrics[] = {
+	{ "frame_interval_ms.p50", +1 },
+	{ "frame_interval_ms.p99", +1 },
+	{ "frame_cpu_ms.p50", +1 },
+	{ "frame_cpu_ms.p99", +1 },
+	{ "frame_gpu_ms.p50", +1 },
+	{ "frame_gpu_ms.p99", +1 },
+	{ "latency_ms.p50", +1 },
+	{ "latency_ms.p99", +1 },
+	{ "cpu_percent", +1 },
+	{ "rss_peak_kb", +1 },
+	{ "fps", -1 },
+};
+
+/*
+ * Just enough JSON for void_bench output: nested objects of numbers
+ * and strings, flattened to "outer.inner" keys.  Strings go to *name
+ * when the key is "scenario".
+ */
+static bool parse_object(const char *&p, const std::string &prefix,
+		sample_t &out, std::string &name) {
+	auto skip = [&]() {
+		while (*p == ' ' || *p == '\t') {
+			p++;
+		}
+	};
+	auto string = [&](std::string &s) {
+		if (*p != '"') {
+			return false;
+		}
+		const char *end = strchr(++p, '"');
+		if (!end) {
+			return false;
+		}
+		s.assign(p, end);
+		p = end + 1;
+		return true;
+	};
+
+	skip();
+	if (*p++ != '{') {
+		return false;
+	}
+	skip();
+	if (*p == '}') {
+		p++;
+		return true;
+	}
+	for (;;) {
+		std::string key;
+		skip();
+		if (!string(key)) {
+			return false;
+		}
+		skip();
+		if (*p++ != ':') {
+			return false;
+		}
+		skip();
+		key = prefix + key;
+		if (*p == '{') {
+			if (!parse_object(p, key + ".", out, name)) {
+				return false;
+			}
+		} else if (*p == '"') {
+			std::string value;
+			if (!string(value)) {
+				return false;
+			}
+			if (key == "scenario") {
+				name = value;
+			}
+		} else {
+			char *end;
+			out[key] = strtod(p, &end);
+			if (end == p) {
+				return false;
+			}
+			p = end;
+		}
+		skip();
+		if (*p == ',') {
+			p++;
+			continue;
+		}
+		return *p++ == '}';
+	}
+}
+
+static int load(const std::string &file, results_t &results) {
+	std::ifstream in(file);
+	if (!in) {
+		return -1;
+	}
+	std::string line;
+	int n = 0;
+	while (std::getline(in, line)) {
+		if (line.empty()) {
+			continue;
+		}
+		sample_t sample;
+		std::string name;
+		const char *p = line.c_str();
+		if (!parse_object(p, "", sample, name) || name.empty()) {
+			fprintf(stderr, "%s:%d: bad result line\n", file.c_str(), n + 1);
+			continue;
+		}
+		results[name].push_back(sample);
+		n++;
+	}
+	return n;
+}
+
+/* two-sided 95% critical values of Student's t, by degrees of freedom */
+static double t_critical(double df) {
+	static const double table[] = {
+		12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306,
+		2.262, 2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120,
+		2.110, 2.101, 2.093, 2.086, 2.080, 2.074, 2.069, 2.064,
+		2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+	};
+	int i = (int)df;
+	if (i < 1) {
+		return table[0];
+	}
+	if (i > 30) {
+		return 1.960;
+	}
+	return table[i - 1];
+}
+
+struct stats {
+	int n;
+	double mean, var;
+};
+
+static stats describe(const std::vector<sample_t> &samples, const char *key) {
+	stats s = { 0, 0, 0 };
+	for (auto &&sample : samples) {
+		auto it = sample.find(key);
+		if (it == sample.end()) {
+			continue;
+		}
+		s.n++;
+		s.mean += it->second;
+	}
+	if (s.n == 0) {
+		return s;
+	}
+	s.mean /= s.n;
+	for (auto &&sample : samples) {
+		auto it = sample.find(key);
+		if (it != sample.end()) {
+			s.var += (it->second - s.mean) * (it->second - s.mean);
+		}
+	}
+	if (s.n > 1) {
+		s.var /= s.n - 1;
+	}
+	return s;
+}
+
+/* returns 1 if any metric of the scenario regressed */
+static int compare(const std::string &name, const std::vector<sample_t> &base,
+		const std::vector<sample_t> &cur, double threshold) {
+	int regressed = 0;
+	for (auto &&m : metrics) {
+		stats b = describe(base, m.key);
+		stats c = describe(cur, m.key);
+		if (b.n == 0 || c.n == 0) {
+			continue;
+		}
+
+		const char *verdict = "ok";
+		double diff = c.mean - b.mean;
+		double change = b.mean != 0 ? diff / b.mean * 100 : 0;
+		double ci = 0;
+		if (b.n < 2 || c.n < 2) {
+			verdict = "too few runs";
+		} else {
+			double vb = b.var / b.n, vc = c.var / c.n;
+			double se = sqrt(vb + vc);
+			double df = se > 0 ? (vb + vc) * (vb + vc) /
+				(vb * vb / (b.n - 1) + vc * vc / (c.n - 1)) : 1e9;
+			ci = t_critical(df) * se;
+			bool significant = diff * m.worse - ci > 0;
+			bool large = b.mean != 0 ?
+				change * m.worse > threshold : diff * m.worse > 0;
+			if (significant && large) {
+				verdict = "REGRESSED";
+				regressed = 1;
+			} else if (-diff * m.worse - ci > 0 && -change * m.worse > threshold) {
+				verdict = "improved";
+			}
+		}
+		printf("%-10s %-22s %12.3f %12.3f %+8.1f%% %10.3f  %s\n",
+				name.c_str(), m.key, b.mean, c.mean, change, ci, verdict);
+	}
+	return regressed;
+}
+
+static int update(const std::string &dir, const results_t &results) {
+	for (auto &&r : results) {
+		std::string file = dir + "/" + r.first + ".json";
+		FILE *f = fopen(file.c_str(), "w");
+		if (!f) {
+			fprintf(stderr, "%s: %s\n", file.c_str(), strerror(errno));
+			return 2;
+		}
+		for (auto &&sample : r.second) {
+			std::string sep = "{\"scenario\":\"" + r.first + "\"";
+			fputs(sep.c_str(), f);
+			for (auto &&kv : sample) {
+				fprintf(f, ",\"%s\":%.17g", kv.first.c_str(), kv.second);
+			}
+			fputs("}\n", f);
+		}
+		fclose(f);
+		printf("%s: %zu runs saved to %s\n", r.first.c_str(),
+				r.second.size(), file.c_str());
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+	double threshold = 5;
+	bool do_update = false;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "t:u")) != -1) {
+		switch (opt) {
+		case 't': threshold = atof(optarg); break;
+		case 'u': do_update = true; break;
+		default:
+			optind = argc + 1;
+		}
+	}
+	if (argc - optind != 2) {
+		fprintf(stderr, "usage: %s [-t percent] <baseline dir> <results>\n"
+				"       %s -u <baseline dir> <results>\n", argv[0], argv[0]);
+		return 2;
+	}
+	std::string dir = argv[optind], file = argv[optind + 1];
+
+	results_t current;
+	if (load(file, current) <= 0) {
+		fprintf(stderr, "%s: no results\n", file.c_str());
+		return 2;
+	}
+	if (do_update) {
+		return update(dir, current);
+	}
+
+	printf("%-10s %-22s %12s %12s %9s %10s  %s\n", "SCENARIO", "METRIC",
+			"BASELINE", "CURRENT", "CHANGE", "CI95", "");
+	int regressed = 0;
+	for (auto &&r : current) {
+		results_t base;
+		if (load(dir + "/" + r.first + ".json", base) <= 0) {
+			printf("%-10s no baseline\n", r.first.c_str());
+			continue;
+		}
+		regressed |= compare(r.first, base[r.first], r.second, threshold);
+	}
+	return regressed;
+}
+
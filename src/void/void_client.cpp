@@ -0,0 +1,123 @@
+/* void_client.cpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+
+#include "void_client.hpp"
+#include "void_log.hpp"
+
+void_client::void_client(wayland::client_t c, uint32_t id, const limits_t &l)
+	: client(c), id(id), limits(l),
+	shm_bytes(0), texture_bytes(0),
+	throttled_frames(0), wasted_commits(0),
+	state(LIMIT_NONE)
+{
+	for (auto &&o : objects) {
+		o = 0;
+	}
+	if (limits.throttle_divisor < 1) {
+		limits.throttle_divisor = 1;
+	}
+}
+
+bool void_client::add_buffer(uint32_t buf_id, int64_t bytes) {
+	auto it = buffer_dict.find(buf_id);
+	if (it != buffer_dict.end()) {
+		// same id, maybe recreated with another size
+		shm_bytes += bytes - it->second;
+		it->second = bytes;
+		return false;
+	}
+	buffer_dict[buf_id] = bytes;
+	shm_bytes += bytes;
+	ref_object(OBJ_BUFFER);
+	return true;
+}
+
+void void_client::remove_buffer(uint32_t buf_id) {
+	auto it = buffer_dict.find(buf_id);
+	if (it == buffer_dict.end()) {
+		return;
+	}
+	shm_bytes -= it->second;
+	buffer_dict.erase(it);
+	unref_object(OBJ_BUFFER);
+}
+
+void_client::limit_state void_client::check_limits() {
+	int64_t usage = get_memory_usage();
+	limit_state s = LIMIT_NONE;
+	if (limits.hard && usage > limits.hard) {
+		s = LIMIT_HARD;
+	} else if (limits.soft && usage > limits.soft) {
+		s = LIMIT_SOFT;
+	}
+
+	if (s != state) {
+		log_warn(LOG_CLIENT, "client %u: %lld bytes, %s", id,
+				(long long)usage,
+				s == LIMIT_HARD ? "over hard limit" :
+				s == LIMIT_SOFT ? "over soft limit, throttling" :
+				"back under limits");
+		state = s;
+	}
+	return s;
+}
+
+bool void_client::frame_allowed(uint64_t frame_count) {
+	if (!limits.soft || get_memory_usage() <= limits.soft) {
+		return true;
+	}
+	if (frame_count % limits.throttle_divisor == 0) {
+		return true;
+	}
+	throttled_frames++;
+	return false;
+}
+
+std::string void_client::describe_header() {
+	char line[256];
+	snprintf(line, sizeof line,
+			"%-6s %12s %12s %8s %8s %8s %8s %8s %10s %10s\n",
+			"CLIENT", "SHM", "TEXTURE", "SURFACES", "BUFFERS",
+			"CALLBACK", "SHELL", "POINTER", "THROTTLED", "WASTED");
+	return line;
+}
+
+std::string void_client::describe() {
+	char line[256];
+	snprintf(line, sizeof line,
+			"%-6u %12lld %12lld %8d %8d %8d %8d %8d %10lld %10lld\n",
+			id,
+			(long long)get_shm_bytes(),
+			(long long)get_texture_bytes(),
+			(int)objects[OBJ_SURFACE],
+			(int)objects[OBJ_BUFFER],
+			(int)objects[OBJ_CALLBACK],
+			(int)(objects[OBJ_SHELL_SURFACE] + objects[OBJ_XDG_SURFACE]),
+			(int)objects[OBJ_POINTER],
+			(long long)throttled_frames,
+			(long long)wasted_commits);
+	return line;
+}
+
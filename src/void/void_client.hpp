@@ -0,0 +1,230 @@
+/* void_client.hpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __VOID_CLIENT_HPP_
+#define __VOID_CLIENT_HPP_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+#include <map>
+
+#include <wayland-server.hpp>
+
+#include "void_latency.hpp"
+
+/* plain copy of a void_cost, to take differences of */
+struct void_cost_sample {
+	uint64_t commits;
+	uint64_t uploads;
+	uint64_t upload_bytes;
+	uint64_t upload_ns;
+	uint64_t draw_ns;
+	uint64_t draw_pixels;
+
+	void_cost_sample()
+		: commits(0), uploads(0), upload_bytes(0),
+		upload_ns(0), draw_ns(0), draw_pixels(0)
+	{
+	}
+
+	void_cost_sample operator-(const void_cost_sample &o) const {
+		void_cost_sample d;
+		d.commits = commits - o.commits;
+		d.uploads = uploads - o.uploads;
+		d.upload_bytes = upload_bytes - o.upload_bytes;
+		d.upload_ns = upload_ns - o.upload_ns;
+		d.draw_ns = draw_ns - o.draw_ns;
+		d.draw_pixels = draw_pixels - o.draw_pixels;
+		return d;
+	}
+
+	/* what the query socket sorts by */
+	uint64_t get_time() const {
+		return upload_ns + draw_ns;
+	}
+};
+
+/**
+ * Rendering work done on behalf of a client or one of its surfaces.
+ *
+ * Upload time is the time spent copying buffers into textures, on
+ * whichever thread did it; draw time is the CPU time of issuing the
+ * draw, with the pixels drawn as a measure of the GPU side.
+ */
+struct void_cost {
+	std::atomic<uint64_t> commits;
+	std::atomic<uint64_t> uploads;
+	std::atomic<uint64_t> upload_bytes;
+	std::atomic<uint64_t> upload_ns;
+	std::atomic<uint64_t> draw_ns;
+	std::atomic<uint64_t> draw_pixels;
+
+	void_cost()
+		: commits(0), uploads(0), upload_bytes(0),
+		upload_ns(0), draw_ns(0), draw_pixels(0)
+	{
+	}
+
+	void add_commit() {
+		commits.fetch_add(1, std::memory_order_relaxed);
+	}
+	void add_upload(uint64_t bytes, uint64_t ns) {
+		uploads.fetch_add(1, std::memory_order_relaxed);
+		upload_bytes.fetch_add(bytes, std::memory_order_relaxed);
+		upload_ns.fetch_add(ns, std::memory_order_relaxed);
+	}
+	void add_draw(uint64_t ns, uint64_t pixels) {
+		draw_ns.fetch_add(ns, std::memory_order_relaxed);
+		draw_pixels.fetch_add(pixels, std::memory_order_relaxed);
+	}
+
+	void_cost_sample sample() const {
+		void_cost_sample s;
+		s.commits = commits;
+		s.uploads = uploads;
+		s.upload_bytes = upload_bytes;
+		s.upload_ns = upload_ns;
+		s.draw_ns = draw_ns;
+		s.draw_pixels = draw_pixels;
+		return s;
+	}
+};
+
+/**
+ * Per-client resource accounting.
+ *
+ * shm usage is counted per distinct wl_buffer the client attaches
+ * (stride * height), texture usage per texture allocated for its
+ * surfaces. Counters are written from the dispatch and render threads
+ * and read from the control socket, hence atomics.
+ */
+class void_client {
+public:
+	enum object_type {
+		OBJ_SURFACE,
+		OBJ_BUFFER,
+		OBJ_CALLBACK,
+		OBJ_SHELL_SURFACE,
+		OBJ_XDG_SURFACE,
+		OBJ_POINTER,
+		OBJ_COUNT
+	};
+
+	enum limit_state {
+		LIMIT_NONE,
+		LIMIT_SOFT,	/* frame callbacks are throttled */
+		LIMIT_HARD,	/* client gets disconnected */
+	};
+
+	struct limits_t {
+		int64_t soft;	/* bytes, 0 means unlimited */
+		int64_t hard;
+		int throttle_divisor;
+	};
+
+private:
+	wayland::client_t client;
+	uint32_t id;
+	limits_t limits;
+
+	std::atomic<int64_t> shm_bytes;
+	std::atomic<int64_t> texture_bytes;
+	std::atomic<int32_t> objects[OBJ_COUNT];
+	std::atomic<int64_t> throttled_frames;
+	/* commits of content identical to what was on screen */
+	std::atomic<int64_t> wasted_commits;
+	void_cost cost;
+	void_latency latency;
+
+	/* buffer id -> bytes, dispatch thread only */
+	std::map<uint32_t, int64_t> buffer_dict;
+
+	limit_state state;
+
+public:
+	void_client(wayland::client_t c, uint32_t id, const limits_t &l);
+
+	wayland::client_t &get_client() {
+		return client;
+	}
+	uint32_t get_id() {
+		return id;
+	}
+
+	void ref_object(object_type t) {
+		objects[t]++;
+	}
+	void unref_object(object_type t) {
+		objects[t]--;
+	}
+	int32_t get_objects(object_type t) {
+		return objects[t];
+	}
+
+	/* returns true the first time the buffer is seen */
+	bool add_buffer(uint32_t buf_id, int64_t bytes);
+	void remove_buffer(uint32_t buf_id);
+
+	void add_texture(int64_t bytes) {
+		texture_bytes += bytes;
+	}
+	void remove_texture(int64_t bytes) {
+		texture_bytes -= bytes;
+	}
+
+	int64_t get_shm_bytes() {
+		return shm_bytes;
+	}
+	int64_t get_texture_bytes() {
+		return texture_bytes;
+	}
+	int64_t get_memory_usage() {
+		return shm_bytes + texture_bytes;
+	}
+
+	void_cost &get_cost() {
+		return cost;
+	}
+	void_latency &get_latency() {
+		return latency;
+	}
+
+	/* render thread, for commits that changed nothing on screen */
+	void count_wasted_commit() {
+		wasted_commits.fetch_add(1, std::memory_order_relaxed);
+	}
+	int64_t get_wasted_commits() {
+		return wasted_commits;
+	}
+
+	limit_state check_limits();
+	bool frame_allowed(uint64_t frame_count);
+
+	std::string describe();
+	static std::string describe_header();
+};
+
+#endif
+
@@ -0,0 +1,149 @@
+/* void_clock.cpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "void_clock.hpp"
+
+/* how long advance() waits for the render thread to catch up */
+#define SETTLE_TIMEOUT 5000000000ull
+
+static std::mutex mutex;
+static std::condition_variable cond;
+static bool simulated = false;
+static std::atomic<uint64_t> frame_period(1000000000ull / 60);
+
+/* simulated time starts at 1s, 0 means unset in a few places */
+static std::atomic<uint64_t> sim_now(1000000000ull);
+/* where advance() is taking the clock */
+static uint64_t target = 1000000000ull;
+/* the frame the render thread waits for, 0 while it draws */
+static uint64_t waiting_for = 0;
+
+static uint64_t real_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+uint64_t void_clock::now() {
+	if (simulated) {
+		return sim_now.load(std::memory_order_relaxed);
+	}
+	return real_now();
+}
+
+uint32_t void_clock::now_ms() {
+	return now() / 1000000;
+}
+
+void void_clock::set_simulated(bool on) {
+	simulated = on;
+}
+
+bool void_clock::is_simulated() {
+	return simulated;
+}
+
+void void_clock::set_refresh_rate(int hz) {
+	frame_period = 1000000000ull / (hz > 0 ? hz : 60);
+}
+
+uint64_t void_clock::get_frame_period() {
+	return frame_period;
+}
+
+bool void_clock::wait_until(uint64_t due, uint64_t timeout) {
+	if (!simulated) {
+		uint64_t t = real_now();
+		if (due > t) {
+			uint64_t ns = std::min(due - t, timeout);
+			std::this_thread::sleep_for(std::chrono::nanoseconds(ns));
+		}
+		return real_now() >= due;
+	}
+
+	std::unique_lock<std::mutex> lock(mutex);
+	waiting_for = due;
+	cond.notify_all();
+	bool reached = cond.wait_for(lock, std::chrono::nanoseconds(timeout),
+			[due]() { return target >= due; });
+	if (reached && sim_now < due) {
+		sim_now = due;
+	}
+	waiting_for = 0;
+	return reached;
+}
+
+int void_clock::advance(uint64_t ns) {
+	if (!simulated) {
+		return -1;
+	}
+	std::unique_lock<std::mutex> lock(mutex);
+	target = std::max<uint64_t>(target, sim_now) + ns;
+	cond.notify_all();
+	// settled when the render thread waits for a frame past the target
+	bool settled = cond.wait_for(lock,
+			std::chrono::nanoseconds(SETTLE_TIMEOUT),
+			[]() { return waiting_for > target; });
+	sim_now = target;
+	return settled ? 0 : -1;
+}
+
+std::string void_clock::command(const std::string &args) {
+	std::istringstream in(args);
+	std::string what;
+	double n = 0;
+	in >> what >> n;
+	if (what == "advance" || what == "frames") {
+		if (!simulated) {
+			return "the clock is not simulated\n";
+		}
+		uint64_t ns = what == "frames" ?
+			(uint64_t)(n * frame_period) : (uint64_t)(n * 1e6);
+		if (advance(ns) < 0) {
+			return "render thread did not catch up\n";
+		}
+	} else if (!what.empty()) {
+		return "usage: clock [advance <ms> | frames <count>]\n";
+	}
+
+	char out[128];
+	snprintf(out, sizeof out,
+			"simulated %d\n"
+			"now_ns %llu\n",
+			simulated ? 1 : 0,
+			(unsigned long long)now());
+	return out;
+}
+
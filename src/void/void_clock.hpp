@@ -0,0 +1,68 @@
+/* void_clock.hpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __VOID_CLOCK_HPP_
+#define __VOID_CLOCK_HPP_
+
+#include <stdint.h>
+
+#include <string>
+
+/**
+ * The compositor's time: frame pacing, frame callback and input
+ * timestamps, and the latency figures built on them.
+ *
+ * It follows CLOCK_MONOTONIC unless simulated. A simulated clock only
+ * moves on advance(), and the frame timer fires once for every refresh
+ * period it passes, so a harness can step the scheduler and read back
+ * exact figures. The cost of work (CPU time per frame, uploads, draws)
+ * is still measured with void_metrics::now().
+ */
+namespace void_clock {
+	/* ns */
+	uint64_t now();
+	/* for protocol timestamps */
+	uint32_t now_ms();
+
+	/* before anything reads the clock */
+	void set_simulated(bool on);
+	bool is_simulated();
+
+	void set_refresh_rate(int hz);
+	uint64_t get_frame_period();
+
+	/*
+	 * Frame timer, render thread: returns true once the clock reaches
+	 * due, false after timeout ns of real time without getting there.
+	 */
+	bool wait_until(uint64_t due, uint64_t timeout);
+
+	/* simulated; returns once the frames that came due are drawn */
+	int advance(uint64_t ns);
+
+	/* the "clock" control command */
+	std::string command(const std::string &args);
+}
+
+#endif
+
@@ -0,0 +1,198 @@
+/* void_config.cpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <ctype.h>
+
+#include <fstream>
+
+#include "void_config.hpp"
+#include "void_log.hpp"
+
+static std::string trim(const std::string &s) {
+	size_t b = 0, e = s.size();
+	while (b < e && isspace(s[b]))
+		b++;
+	while (e > b && isspace(s[e - 1]))
+		e--;
+	return s.substr(b, e - b);
+}
+
+void_config::void_config() {
+	const char *file = getenv("VOID_CONFIG");
+	if (file) {
+		load(file);
+		return;
+	}
+
+	std::string dir;
+	const char *xdg = getenv("XDG_CONFIG_HOME");
+	const char *home = getenv("HOME");
+	if (xdg && *xdg) {
+		dir = xdg;
+	} else if (home) {
+		dir = std::string(home) + "/.config";
+	} else {
+		return;
+	}
+	load(dir + "/void/void.conf");
+}
+
+int void_config::load(const std::string &filename) {
+	std::ifstream in(filename);
+	if (!in) {
+		return -1;
+	}
+	path = filename;
+
+	std::string line, section;
+	int lineno = 0;
+	while (std::getline(in, line)) {
+		lineno++;
+		size_t hash = line.find('#');
+		if (hash != std::string::npos) {
+			line.erase(hash);
+		}
+		line = trim(line);
+		if (line.empty()) {
+			continue;
+		}
+
+		if (line[0] == '[') {
+			size_t end = line.find(']');
+			if (end == std::string::npos) {
+				log_warn(LOG_CORE, "%s:%d: unterminated section.",
+						filename.c_str(), lineno);
+				continue;
+			}
+			section = trim(line.substr(1, end - 1));
+			continue;
+		}
+
+		size_t eq = line.find('=');
+		if (eq == std::string::npos) {
+			log_warn(LOG_CORE, "%s:%d: expected key = value.",
+					filename.c_str(), lineno);
+			continue;
+		}
+		std::string key = trim(line.substr(0, eq));
+		std::string value = trim(line.substr(eq + 1));
+		if (!section.empty()) {
+			key = section + "." + key;
+		}
+		values[key] = value;
+	}
+
+	return 0;
+}
+
+bool void_config::lookup(const std::string &key, std::string &value) const {
+	std::string env = "VOID_";
+	for (char c : key) {
+		env += isalnum(c) ? toupper(c) : '_';
+	}
+	const char *v = getenv(env.c_str());
+	if (v) {
+		value = v;
+		return true;
+	}
+
+	auto it = values.find(key);
+	if (it == values.end()) {
+		return false;
+	}
+	value = it->second;
+	return true;
+}
+
+std::string void_config::get_string(const std::string &key,
+		const std::string &def) const {
+	std::string v;
+	if (!lookup(key, v)) {
+		return def;
+	}
+	return v;
+}
+
+int64_t void_config::get_int(const std::string &key, int64_t def) const {
+	std::string v;
+	if (!lookup(key, v)) {
+		return def;
+	}
+	char *end;
+	long long n = strtoll(v.c_str(), &end, 0);
+	if (end == v.c_str()) {
+		return def;
+	}
+	return n;
+}
+
+double void_config::get_double(const std::string &key, double def) const {
+	std::string v;
+	if (!lookup(key, v)) {
+		return def;
+	}
+	char *end;
+	double d = strtod(v.c_str(), &end);
+	if (end == v.c_str()) {
+		return def;
+	}
+	return d;
+}
+
+bool void_config::get_bool(const std::string &key, bool def) const {
+	std::string v;
+	if (!lookup(key, v)) {
+		return def;
+	}
+	if (v == "1" || v == "true" || v == "yes" || v == "on") {
+		return true;
+	}
+	if (v == "0" || v == "false" || v == "no" || v == "off") {
+		return false;
+	}
+	return def;
+}
+
+int64_t void_config::get_size(const std::string &key, int64_t def) const {
+	std::string v;
+	if (!lookup(key, v)) {
+		return def;
+	}
+	char *end;
+	double n = strtod(v.c_str(), &end);
+	if (end == v.c_str()) {
+		return def;
+	}
+	switch (toupper(*end)) {
+		case 'G':
+			n *= 1024;
+		case 'M':
+			n *= 1024;
+		case 'K':
+			n *= 1024;
+			break;
+	}
+	return (int64_t)n;
+}
+
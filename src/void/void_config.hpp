@@ -0,0 +1,72 @@
+/* void_config.hpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __VOID_CONFIG_HPP_
+#define __VOID_CONFIG_HPP_
+
+#include <stdint.h>
+
+#include <string>
+#include <map>
+
+/**
+ * Compositor settings.
+ *
+ * Loaded from $VOID_CONFIG, or $XDG_CONFIG_HOME/void/void.conf.
+ * The file is made of "key = value" lines, grouped by "[section]"
+ * headers; a key inside a section is looked up as "section.key".
+ * Any key can be overridden from the environment as VOID_SECTION_KEY,
+ * e.g. VOID_CLIENT_SOFT_LIMIT overrides "client.soft_limit".
+ */
+class void_config {
+private:
+	std::map<std::string, std::string> values;
+	std::string path;
+
+	bool lookup(const std::string &key, std::string &value) const;
+
+public:
+	void_config();
+
+	int load(const std::string &filename);
+
+	const std::string &get_path() const {
+		return path;
+	}
+
+	std::string get_string(const std::string &key,
+			const std::string &def = "") const;
+	int64_t get_int(const std::string &key, int64_t def = 0) const;
+	double get_double(const std::string &key, double def = 0) const;
+	bool get_bool(const std::string &key, bool def = false) const;
+
+	/* byte sizes, accepts K/M/G suffixes */
+	int64_t get_size(const std::string &key, int64_t def = 0) const;
+
+	void set(const std::string &key, const std::string &value) {
+		values[key] = value;
+	}
+};
+
+#endif
+
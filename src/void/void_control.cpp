@@ -0,0 +1,218 @@
+/* void_control.cpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include "void_control.hpp"
+#include "void_log.hpp"
+
+/* beyond that, connections are dropped until one is done */
+#define MAX_CONNECTIONS 8
+
+void_control::void_control()
+	: listen_fd(-1), running(false), td(NULL), connections(0)
+{
+	register_command("help", [this](const std::string &) {
+		std::string out;
+		std::lock_guard<std::mutex> lock(cmd_mutex);
+		for (auto &&c : command_dict) {
+			out += c.first + "\n";
+		}
+		return out;
+	});
+}
+
+void_control::~void_control() {
+	stop();
+}
+
+int void_control::start(const std::string &socket_path) {
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+	if (socket_path.size() >= sizeof addr.sun_path) {
+		log_error(LOG_CORE, "control socket path too long: %s",
+				socket_path.c_str());
+		return -1;
+	}
+	strcpy(addr.sun_path, socket_path.c_str());
+
+	listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (listen_fd < 0) {
+		log_error(LOG_CORE, "control socket: %s", strerror(errno));
+		return -1;
+	}
+
+	unlink(socket_path.c_str());
+	if (bind(listen_fd, (sockaddr *)&addr, sizeof addr) < 0 ||
+			listen(listen_fd, 4) < 0) {
+		log_error(LOG_CORE, "control socket %s: %s",
+				socket_path.c_str(), strerror(errno));
+		close(listen_fd);
+		listen_fd = -1;
+		return -1;
+	}
+
+	path = socket_path;
+	running = true;
+	td = new std::thread(&void_control::run, this);
+	return 0;
+}
+
+void void_control::stop() {
+	if (!td) {
+		return;
+	}
+	running = false;
+	// wakes accept() up
+	shutdown(listen_fd, SHUT_RDWR);
+	td->join();
+	delete td;
+	td = NULL;
+	{
+		std::unique_lock<std::mutex> lock(conn_mutex);
+		conn_cond.wait(lock, [this]() {
+			return connections == 0;
+		});
+	}
+
+	close(listen_fd);
+	listen_fd = -1;
+	unlink(path.c_str());
+}
+
+void void_control::register_command(const std::string &name, command_t f) {
+	std::lock_guard<std::mutex> lock(cmd_mutex);
+	command_dict[name] = f;
+}
+
+std::string void_control::execute(const std::string &line) {
+	size_t sp = line.find(' ');
+	std::string name = line.substr(0, sp);
+	std::string args = sp == std::string::npos ? "" : line.substr(sp + 1);
+
+	command_t f;
+	{
+		std::lock_guard<std::mutex> lock(cmd_mutex);
+		auto it = command_dict.find(name);
+		if (it == command_dict.end()) {
+			return "unknown command: " + name + "\n";
+		}
+		f = it->second;
+	}
+	return f(args);
+}
+
+std::string void_control::execute_http(const std::string &line) {
+	std::string target = line.substr(4, line.find(' ', 4) - 4);
+	size_t start = target.find_first_not_of('/');
+	std::string name = start == std::string::npos ?
+		"help" : target.substr(start, target.find('?') - start);
+
+	bool found;
+	{
+		std::lock_guard<std::mutex> lock(cmd_mutex);
+		found = command_dict.count(name) > 0;
+	}
+	if (!found) {
+		return "HTTP/1.0 404 Not Found\r\n"
+			"Content-Type: text/plain\r\n\r\n"
+			"unknown command: " + name + "\n";
+	}
+	std::string body = execute(name);
+	return "HTTP/1.0 200 OK\r\n"
+		"Content-Type: text/plain; version=0.0.4\r\n"
+		"Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" +
+		body;
+}
+
+void void_control::run() {
+	while (running) {
+		int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		{
+			std::lock_guard<std::mutex> lock(conn_mutex);
+			if (connections >= MAX_CONNECTIONS) {
+				close(fd);
+				continue;
+			}
+			connections++;
+		}
+		std::thread(&void_control::serve_and_close, this, fd).detach();
+	}
+}
+
+void void_control::serve_and_close(int fd) {
+	serve(fd);
+	close(fd);
+	std::lock_guard<std::mutex> lock(conn_mutex);
+	connections--;
+	conn_cond.notify_all();
+}
+
+void void_control::serve(int fd) {
+	std::string line;
+	char buf[256];
+	while (line.find('\n') == std::string::npos && line.size() < 4096) {
+		ssize_t n = read(fd, buf, sizeof buf);
+		if (n <= 0) {
+			break;
+		}
+		line.append(buf, n);
+	}
+	line = line.substr(0, line.find('\n'));
+	if (!line.empty() && line.back() == '\r') {
+		line.pop_back();
+	}
+
+	std::string out;
+	if (line.compare(0, 4, "GET ") == 0) {
+		out = execute_http(line);
+	} else {
+		out = execute(line);
+	}
+
+	size_t off = 0;
+	while (off < out.size()) {
+		// a client gone before the answer must not SIGPIPE us
+		ssize_t n = send(fd, out.data() + off, out.size() - off,
+				MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		off += n;
+	}
+}
+
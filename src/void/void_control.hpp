@@ -0,0 +1,85 @@
+/* void_control.hpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __VOID_CONTROL_HPP_
+#define __VOID_CONTROL_HPP_
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+
+/**
+ * Local query socket.
+ *
+ * Listens on a UNIX stream socket, reads one request line per connection,
+ * e.g. "clients", and answers with the text returned by the command
+ * registered under the first word of that line. Each connection gets a
+ * thread of its own, so a sampling "top" does not hold up the others.
+ *
+ * A "GET /<command> HTTP/1.x" line is answered as an HTTP/1.0 response,
+ * so e.g. /metrics can be scraped in the Prometheus text format through
+ * a proxy that speaks HTTP over UNIX sockets.
+ */
+class void_control {
+public:
+	typedef std::function<std::string(const std::string &args)> command_t;
+
+private:
+	std::string path;
+	int listen_fd;
+	bool running;
+	std::thread *td;
+
+	std::mutex cmd_mutex;
+	std::map<std::string, command_t> command_dict;
+
+	/* connections being served, stop() waits for them */
+	std::mutex conn_mutex;
+	std::condition_variable conn_cond;
+	int connections;
+
+	void run();
+	void serve(int fd);
+	void serve_and_close(int fd);
+	std::string execute_http(const std::string &line);
+
+public:
+	void_control();
+	~void_control();
+
+	int start(const std::string &socket_path);
+	void stop();
+
+	void register_command(const std::string &name, command_t f);
+	std::string execute(const std::string &line);
+
+	const std::string &get_path() const {
+		return path;
+	}
+};
+
+#endif
+
@@ -0,0 +1,152 @@
+/* void_format.cpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <algorithm>
+
+#include "void_format.hpp"
+#include "wrapper.hpp"
+
+using namespace wayland;
+
+static void set_plane(void_plane &p, size_t offset, int32_t stride,
+		int32_t width, int32_t height, int32_t vsub, GLenum format,
+		GLenum type, int32_t texel_size) {
+	p.offset = offset;
+	p.stride = stride;
+	p.width = width;
+	p.height = height;
+	p.vsub = vsub;
+	p.format = format;
+	p.type = type;
+	p.texel_size = texel_size;
+}
+
+/*
+ * wl_shm formats are little endian: a packed 16 bit RGB565 pixel has
+ * red in its top bits, just like GL_UNSIGNED_SHORT_5_6_5, and
+ * ABGR8888 is R, G, B, A in memory, just like GL_RGBA bytes. These
+ * upload as they are.
+ */
+bool void_format::describe(shm_format format, int32_t width,
+		int32_t height, int32_t stride) {
+	// chroma is subsampled 2x2, odd sizes round up
+	int32_t cw = (width + 1) / 2;
+	int32_t ch = (height + 1) / 2;
+	size_t luma = (size_t)stride * height;
+
+	shader = SHADER_RGBA;
+	plane_count = 1;
+	switch (format) {
+	case shm_format::argb8888:
+	case shm_format::xrgb8888:
+		// B, G, R, A/X in memory, swapped to RGBA when sampled, the
+		// client's memory is never touched
+		shader = SHADER_BGRA;
+		set_plane(planes[0], 0, stride, width, height, 1,
+				GL_RGBA, GL_UNSIGNED_BYTE, 4);
+		return true;
+	case shm_format::abgr8888:
+	case shm_format::xbgr8888:
+		set_plane(planes[0], 0, stride, width, height, 1,
+				GL_RGBA, GL_UNSIGNED_BYTE, 4);
+		return true;
+	case shm_format::rgb565:
+		set_plane(planes[0], 0, stride, width, height, 1,
+				GL_RGB, GL_UNSIGNED_SHORT_5_6_5, 2);
+		break;
+	case shm_format::rgba4444:
+	case shm_format::rgbx4444:
+		set_plane(planes[0], 0, stride, width, height, 1,
+				GL_RGBA, GL_UNSIGNED_SHORT_4_4_4_4, 2);
+		break;
+	case shm_format::rgba5551:
+	case shm_format::rgbx5551:
+		set_plane(planes[0], 0, stride, width, height, 1,
+				GL_RGBA, GL_UNSIGNED_SHORT_5_5_5_1, 2);
+		break;
+	case shm_format::nv12:
+		shader = SHADER_NV12;
+		plane_count = 2;
+		set_plane(planes[0], 0, stride, width, height, 1,
+				GL_LUMINANCE, GL_UNSIGNED_BYTE, 1);
+		set_plane(planes[1], luma, stride, cw, ch, 2,
+				GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, 2);
+		return true;
+	case shm_format::yuv420:
+		shader = SHADER_YUV420;
+		plane_count = 3;
+		set_plane(planes[0], 0, stride, width, height, 1,
+				GL_LUMINANCE, GL_UNSIGNED_BYTE, 1);
+		set_plane(planes[1], luma, stride / 2, cw, ch, 2,
+				GL_LUMINANCE, GL_UNSIGNED_BYTE, 1);
+		set_plane(planes[2], luma + (size_t)(stride / 2) * ch, stride / 2,
+				cw, ch, 2, GL_LUMINANCE, GL_UNSIGNED_BYTE, 1);
+		return true;
+	default:
+		return false;
+	}
+	// rows are uploaded stride bytes wide, in whole texels
+	return stride % planes[0].texel_size == 0;
+}
+
+size_t void_format::size() const {
+	size_t end = 0;
+	for (int i = 0; i < plane_count; i++) {
+		const void_plane &p = planes[i];
+		end = std::max(end, p.offset + (size_t)p.stride * p.height);
+	}
+	return end;
+}
+
+void void_format::advertise(shm_t &shm) {
+	static const shm_format formats[] = {
+		shm_format::nv12,
+		shm_format::yuv420,
+		shm_format::abgr8888,
+		shm_format::xbgr8888,
+		shm_format::rgb565,
+		shm_format::rgba4444,
+		shm_format::rgbx4444,
+		shm_format::rgba5551,
+		shm_format::rgbx5551,
+	};
+	for (auto f : formats) {
+		shm.add_format(f);
+	}
+}
+
+bool void_format::is_opaque(shm_format format) {
+	switch (format) {
+	case shm_format::xrgb8888:
+	case shm_format::xbgr8888:
+	case shm_format::rgb565:
+	case shm_format::rgbx4444:
+	case shm_format::rgbx5551:
+	case shm_format::nv12:
+	case shm_format::yuv420:
+		return true;
+	default:
+		return false;
+	}
+}
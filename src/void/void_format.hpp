@@ -0,0 +1,70 @@
+/* void_format.hpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef __VOID_FORMAT_HPP_
+#define __VOID_FORMAT_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <GLES2/gl2.h>
+
+#include <wayland-server.hpp>
+
+/* one plane of a buffer, uploaded into a texture of its own */
+struct void_plane {
+	size_t offset;
+	int32_t stride;
+	/* content size in texels, and rows of the buffer per row here */
+	int32_t width, height;
+	int32_t vsub;
+	GLenum format, type;
+	int32_t texel_size;
+};
+
+/**
+ * Where the planes of a wl_shm buffer are and how they are uploaded
+ * and sampled. Packed formats are one plane with the GL type that
+ * matches their bit layout. Multi-planar formats follow the layout
+ * wl_shm clients use: the chroma planes come right after the luma
+ * plane, the stride of a YUV420 chroma plane is half the luma stride.
+ */
+struct void_format {
+	int shader;	/* gl_shader_variant */
+	int plane_count;
+	void_plane planes[3];
+
+	/* false for a format the compositor does not advertise */
+	bool describe(wayland::shm_format format, int32_t width,
+			int32_t height, int32_t stride);
+
+	/* bytes of the buffer the planes span */
+	size_t size() const;
+
+	/* formats advertised on wl_shm besides argb8888 and xrgb8888 */
+	static void advertise(wayland::shm_t &shm);
+	static bool is_opaque(wayland::shm_format format);
+};
+
+#endif
@@ -0,0 +1,122 @@
+/* void_governor.cpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "void_governor.hpp"
+#include "void_config.hpp"
+#include "void_log.hpp"
+
+static const char *level_names[GOV_LEVELS] = {
+	"normal", "half uploads", "quarter uploads", "opaque",
+};
+
+void_governor::void_governor()
+	: enabled(true), high(0.9), low(0.6),
+	up_frames(30), down_frames(180), max_level(GOV_LEVELS - 1),
+	level(GOV_NORMAL), load(0), load_permille(0),
+	frames_over(0), frames_under(0),
+	transitions(0), uploads_skipped(0)
+{
+}
+
+void void_governor::load_config(const void_config &c) {
+	enabled = c.get_bool("governor.enabled", enabled);
+	high = c.get_double("governor.high", high);
+	low = c.get_double("governor.low", low);
+	up_frames = c.get_int("governor.up_frames", up_frames);
+	down_frames = c.get_int("governor.down_frames", down_frames);
+	max_level = c.get_int("governor.max_level", max_level);
+	if (max_level >= GOV_LEVELS) {
+		max_level = GOV_LEVELS - 1;
+	}
+}
+
+void void_governor::set_level(int l, const char *why) {
+	int old = level;
+	level = l;
+	transitions++;
+	frames_over = frames_under = 0;
+	log_info(LOG_RENDER, "governor: %s -> %s, %s at %.0f%% of the frame",
+			level_names[old], level_names[l], why, load * 100);
+}
+
+void void_governor::update(uint64_t cpu, uint64_t interval, uint64_t period) {
+	if (!enabled || !period) {
+		return;
+	}
+	double sample = (double)cpu / period;
+	// a missed refresh, not the host pausing us
+	if (interval > period * 3 / 2 && interval < period * 8) {
+		sample = std::max(sample, (double)interval / period);
+	}
+	load += (sample - load) / 8;
+	load_permille = load * 1000;
+
+	int l = level;
+	if (load > high) {
+		frames_under = 0;
+		if (++frames_over >= up_frames && l < max_level) {
+			set_level(l + 1, "over budget");
+		}
+	} else if (load < low) {
+		frames_over = 0;
+		if (++frames_under >= down_frames && l > GOV_NORMAL) {
+			set_level(l - 1, "recovered");
+		}
+	} else {
+		frames_over = frames_under = 0;
+	}
+}
+
+bool void_governor::skip_upload(bool focused, uint64_t frame_count) {
+	int l = level;
+	if (focused || l < GOV_HALF_UPLOADS) {
+		return false;
+	}
+	int every = l >= GOV_QUARTER_UPLOADS ? 4 : 2;
+	if (frame_count % every == 0) {
+		return false;
+	}
+	uploads_skipped++;
+	return true;
+}
+
+std::string void_governor::describe(const std::string &) {
+	char out[256];
+	snprintf(out, sizeof out,
+			"enabled %d\n"
+			"level %d %s\n"
+			"load %.3f\n"
+			"transitions %llu\n"
+			"uploads_skipped %llu\n",
+			enabled ? 1 : 0,
+			get_level(), level_names[get_level()],
+			load_permille / 1000.0,
+			(unsigned long long)transitions,
+			(unsigned long long)uploads_skipped);
+	return out;
+}
+
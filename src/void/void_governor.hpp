@@ -0,0 +1,95 @@
+/* void_governor.hpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __VOID_GOVERNOR_HPP_
+#define __VOID_GOVERNOR_HPP_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+
+class void_config;
+
+enum gov_level {
+	GOV_NORMAL,
+	/* unfocused surfaces upload on alternate frames */
+	GOV_HALF_UPLOADS,
+	/* and then on every fourth */
+	GOV_QUARTER_UPLOADS,
+	/* translucent surfaces hide what is below them */
+	GOV_OPAQUE,
+	GOV_LEVELS,
+};
+
+/**
+ * Trades quality for frame time when composing falls behind.
+ *
+ * The load is the frame's CPU time over the refresh period, or the
+ * interval over it when a refresh was missed, smoothed over a few
+ * frames. Above the high mark for up_frames the governor goes one
+ * level down in quality, below the low mark for down_frames it comes
+ * back one, so it settles instead of flapping. Render thread only, but
+ * for describe().
+ */
+class void_governor {
+private:
+	bool enabled;
+	double high, low;
+	int up_frames, down_frames;
+	int max_level;
+
+	std::atomic<int> level;
+	/* exponentially weighted, as a fraction of the period */
+	double load;
+	std::atomic<int> load_permille;
+	int frames_over, frames_under;
+
+	std::atomic<uint64_t> transitions;
+	std::atomic<uint64_t> uploads_skipped;
+
+	void set_level(int l, const char *why);
+
+public:
+	void_governor();
+
+	void load_config(const void_config &c);
+
+	/* once per frame, with the figures of the previous one */
+	void update(uint64_t cpu, uint64_t interval, uint64_t period);
+
+	int get_level() {
+		return level.load(std::memory_order_relaxed);
+	}
+
+	bool skip_upload(bool focused, uint64_t frame_count);
+	bool opaque_only() {
+		return get_level() >= GOV_OPAQUE;
+	}
+
+	/* the "governor" control command */
+	std::string describe(const std::string &args);
+};
+
+#endif
+
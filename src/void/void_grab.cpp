@@ -0,0 +1,206 @@
+/* void_grab.cpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "void.hpp"
+#include "void_grab.hpp"
+
+static const char *mode_names[] = { "none", "move", "resize" };
+
+void_grab::void_grab()
+	: mode(GRAB_NONE), surface(NULL), edges(0),
+	x0(0), y0(0), width0(0), height0(0),
+	drag_x(0), drag_y(0), move_x(0), move_y(0),
+	width(0), height(0), sent_width(0), sent_height(0),
+	sent_serial(0), acked(true), awaiting(false),
+	preview(PREVIEW_STRETCH), min_size(64),
+	motions(0), applied(0), configures(0)
+{
+}
+
+void void_grab::load_config(const void_config &c) {
+	std::string p = c.get_string("grab.resize_preview", "stretch");
+	preview = p == "pad" ? PREVIEW_PAD : PREVIEW_STRETCH;
+	min_size = c.get_int("grab.min_size", min_size);
+}
+
+void void_grab::begin_move(void_surface *s) {
+	std::lock_guard<std::mutex> lock(mutex);
+	mode = GRAB_MOVE;
+	surface = s;
+	edges = 0;
+	configure = configure_fn();
+	move_x = move_y = 0;
+}
+
+void void_grab::begin_resize(void_surface *s, uint32_t e, configure_fn f) {
+	void_view *v = s->get_view();
+	std::lock_guard<std::mutex> lock(mutex);
+	mode = GRAB_RESIZE;
+	surface = s;
+	edges = e;
+	configure = f;
+	x0 = v->get_left();
+	y0 = v->get_top();
+	width0 = width = sent_width = v->get_width();
+	height0 = height = sent_height = v->get_height();
+	drag_x = drag_y = 0;
+	acked = true;
+	awaiting = false;
+}
+
+void void_grab::end() {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (mode == GRAB_MOVE) {
+		surface->get_view()->move(move_x, move_y);
+	} else if (mode == GRAB_RESIZE && configure) {
+		// the final size, without the resizing state
+		send_configure(false);
+	}
+	mode = GRAB_NONE;
+	surface = NULL;
+	configure = configure_fn();
+}
+
+void void_grab::cancel(void_surface *s) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (surface != s) {
+		return;
+	}
+	mode = GRAB_NONE;
+	surface = NULL;
+	configure = configure_fn();
+}
+
+void void_grab::update_size() {
+	int32_t dw = (edges & EDGE_RIGHT) ? drag_x :
+		(edges & EDGE_LEFT) ? -drag_x : 0;
+	int32_t dh = (edges & EDGE_BOTTOM) ? drag_y :
+		(edges & EDGE_TOP) ? -drag_y : 0;
+	width = std::max(width0 + dw, min_size);
+	height = std::max(height0 + dh, min_size);
+}
+
+void void_grab::send_configure(bool resizing) {
+	sent_serial = configure(width, height, resizing);
+	acked = sent_serial == 0;
+	awaiting = true;
+	sent_width = width;
+	sent_height = height;
+	configures++;
+}
+
+bool void_grab::motion(int32_t dx, int32_t dy) {
+	std::lock_guard<std::mutex> lock(mutex);
+	motions++;
+	if (mode == GRAB_MOVE) {
+		move_x += dx;
+		move_y += dy;
+		return false;
+	}
+	if (mode != GRAB_RESIZE) {
+		return false;
+	}
+	drag_x += dx;
+	drag_y += dy;
+	update_size();
+	// a slow client gets the latest size once it caught up
+	if (awaiting || (width == sent_width && height == sent_height)) {
+		return false;
+	}
+	send_configure(true);
+	return true;
+}
+
+void void_grab::ack(void_surface *s, uint32_t serial) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (s == surface && serial == sent_serial) {
+		acked = true;
+	}
+}
+
+bool void_grab::committed(void_surface *s, bool attached) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (mode != GRAB_RESIZE || s != surface || !awaiting || !acked ||
+			!attached) {
+		return false;
+	}
+	awaiting = false;
+	if (width == sent_width && height == sent_height) {
+		return false;
+	}
+	send_configure(true);
+	return true;
+}
+
+void void_grab::apply(void_surface *s) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (mode == GRAB_NONE || s != surface) {
+		return;
+	}
+	void_view *v = surface->get_view();
+	applied++;
+	if (mode == GRAB_MOVE) {
+		v->move(move_x, move_y);
+		move_x = move_y = 0;
+		return;
+	}
+	// the edges not dragged stay where they were
+	int32_t x = (edges & EDGE_LEFT) ? x0 + width0 - width : x0;
+	int32_t y = (edges & EDGE_TOP) ? y0 + height0 - height : y0;
+	v->set_geometry(x, y, width, height);
+}
+
+void_grab::preview_mode void_grab::get_preview(void_surface *s) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (mode != GRAB_RESIZE || s != surface) {
+		return PREVIEW_NONE;
+	}
+	return preview;
+}
+
+std::string void_grab::describe(const std::string &) {
+	std::lock_guard<std::mutex> lock(mutex);
+	char out[512];
+	snprintf(out, sizeof out,
+			"mode %s\n"
+			"size %dx%d\n"
+			"sent %dx%d%s\n"
+			"preview %s\n"
+			"motions %llu\n"
+			"frames %llu\n"
+			"configures %llu\n",
+			mode_names[mode],
+			width, height,
+			sent_width, sent_height,
+			awaiting ? (acked ? " acked" : " awaiting ack") : "",
+			preview == PREVIEW_PAD ? "pad" : "stretch",
+			(unsigned long long)motions,
+			(unsigned long long)applied,
+			(unsigned long long)configures);
+	return out;
+}
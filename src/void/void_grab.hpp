@@ -0,0 +1,137 @@
+/* void_grab.hpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef __VOID_GRAB_HPP_
+#define __VOID_GRAB_HPP_
+
+#include <stdint.h>
+
+#include <functional>
+#include <mutex>
+#include <string>
+
+class void_config;
+class void_surface;
+
+/**
+ * Interactive move or resize of a surface, driven by the pointer.
+ *
+ * Motion only accumulates here and the render thread applies it once
+ * per frame, so a fast mouse costs one repaint per refresh instead of
+ * one per event. A resize asks the client for the size being dragged
+ * to with at most one configure outstanding: the next one goes out
+ * once the client has acked the previous and committed a buffer for
+ * it. Until then the last buffer is stretched or padded to that size.
+ *
+ * Motion comes from the input thread, acks and commits from the
+ * dispatch thread, apply() from the render thread; the configure
+ * callback runs on whichever of the first two triggered it.
+ */
+class void_grab {
+public:
+	enum grab_mode {
+		GRAB_NONE,
+		GRAB_MOVE,
+		GRAB_RESIZE,
+	};
+
+	/* as in wl_shell_surface.resize and zxdg_toplevel_v6.resize */
+	enum edge {
+		EDGE_TOP = 1,
+		EDGE_BOTTOM = 2,
+		EDGE_LEFT = 4,
+		EDGE_RIGHT = 8,
+	};
+
+	enum preview_mode {
+		PREVIEW_NONE,
+		PREVIEW_STRETCH,	/* scaled to the size dragged to */
+		PREVIEW_PAD,		/* at its own size, clipped to it */
+	};
+
+	/* sends the size, returns the serial to wait for an ack of or 0 */
+	typedef std::function<uint32_t(int32_t w, int32_t h, bool resizing)>
+		configure_fn;
+
+private:
+	std::mutex mutex;
+	grab_mode mode;
+	void_surface *surface;
+	uint32_t edges;
+	configure_fn configure;
+
+	/* view geometry when the grab began */
+	int32_t x0, y0, width0, height0;
+	/* pointer travel since then, and what apply() has not moved yet */
+	int32_t drag_x, drag_y;
+	int32_t move_x, move_y;
+	/* size being dragged to and the last one sent */
+	int32_t width, height;
+	int32_t sent_width, sent_height;
+	uint32_t sent_serial;
+	bool acked;
+	/* a configure went out and no buffer came for it yet */
+	bool awaiting;
+
+	preview_mode preview;
+	int32_t min_size;
+
+	uint64_t motions;
+	uint64_t applied;
+	uint64_t configures;
+
+	void update_size();
+	void send_configure(bool resizing);
+
+public:
+	void_grab();
+
+	void load_config(const void_config &c);
+
+	/* with scene_mutex held, they read the view's geometry */
+	void begin_move(void_surface *s);
+	void begin_resize(void_surface *s, uint32_t e, configure_fn f);
+	void end();
+	/* the surface is going away */
+	void cancel(void_surface *s);
+
+	bool is_active() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return mode != GRAB_NONE;
+	}
+
+	/* input thread; true if a configure was sent */
+	bool motion(int32_t dx, int32_t dy);
+	/* dispatch thread */
+	void ack(void_surface *s, uint32_t serial);
+	bool committed(void_surface *s, bool attached);
+
+	/* render thread, once per frame right after s took its buffer's size */
+	void apply(void_surface *s);
+	preview_mode get_preview(void_surface *s);
+
+	std::string describe(const std::string &args);
+};
+
+#endif
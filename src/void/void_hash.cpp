@@ -0,0 +1,165 @@
+/* void_hash.cpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "void_hash.hpp"
+
+#define STRIPE 64
+/* stripes between scrambles of the accumulators */
+#define BLOCK_STRIPES 16
+
+static const uint64_t prime32_1 = 0x9e3779b1ull;
+static const uint64_t prime64_1 = 0x9e3779b185ebca87ull;
+static const uint64_t prime64_2 = 0xc2b2ae3d27d4eb4full;
+static const uint64_t prime64_3 = 0x165667b19e3779f9ull;
+
+static const uint64_t secret[8] = {
+	0xbe4ba423396cfeb8ull, 0x1cad21f72c81017cull,
+	0xdb979083e96dd4deull, 0x1f67b3b7a4a44072ull,
+	0x78e5c0cc4ee679cbull, 0x2172ffcc7dd05a82ull,
+	0x8e2443f7744608b8ull, 0x4c263a81e69035e0ull,
+};
+
+/*
+ * The key moves on with every stripe within a block, so equal stripes
+ * at different offsets, like content scrolled by a multiple of 16
+ * pixels, do not cancel out.
+ */
+static inline uint64_t stripe_key(int lane, int stripe) {
+	return secret[lane] + (uint64_t)stripe * prime64_3;
+}
+
+#ifdef __SSE2__
+
+static void accumulate(__m128i acc[4], const uint8_t *p, int stripe) {
+	__m128i step = _mm_set1_epi64x((long long)(stripe * prime64_3));
+	for (int i = 0; i < 4; i++) {
+		__m128i d = _mm_loadu_si128((const __m128i *)(p + i * 16));
+		__m128i s = _mm_loadu_si128((const __m128i *)(secret + i * 2));
+		__m128i k = _mm_xor_si128(d, _mm_add_epi64(s, step));
+		// low half of each key lane times its high half
+		__m128i hi = _mm_shuffle_epi32(k, _MM_SHUFFLE(0, 3, 0, 1));
+		__m128i prod = _mm_mul_epu32(k, hi);
+		// data goes to the neighbouring lane
+		__m128i swapped = _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+		acc[i] = _mm_add_epi64(acc[i], _mm_add_epi64(prod, swapped));
+	}
+}
+
+static void scramble(__m128i acc[4]) {
+	__m128i prime = _mm_set1_epi32((int)prime32_1);
+	for (int i = 0; i < 4; i++) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(secret + i * 2));
+		__m128i a = _mm_xor_si128(acc[i], _mm_srli_epi64(acc[i], 47));
+		a = _mm_xor_si128(a, s);
+		// 64 by 32 bit multiply out of two 32 by 32 bit ones
+		__m128i lo = _mm_mul_epu32(a, prime);
+		__m128i hi = _mm_mul_epu32(_mm_srli_epi64(a, 32), prime);
+		acc[i] = _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+	}
+}
+
+static void hash_stripes(uint64_t lanes[8], const uint8_t *p, size_t n) {
+	__m128i acc[4];
+	for (int i = 0; i < 4; i++) {
+		acc[i] = _mm_loadu_si128((const __m128i *)(lanes + i * 2));
+	}
+	for (size_t s = 0; s < n; s++) {
+		accumulate(acc, p + s * STRIPE, s % BLOCK_STRIPES);
+		if (s % BLOCK_STRIPES == BLOCK_STRIPES - 1) {
+			scramble(acc);
+		}
+	}
+	for (int i = 0; i < 4; i++) {
+		_mm_storeu_si128((__m128i *)(lanes + i * 2), acc[i]);
+	}
+}
+
+#else
+
+static void hash_stripes(uint64_t acc[8], const uint8_t *p, size_t n) {
+	for (size_t s = 0; s < n; s++) {
+		const uint8_t *q = p + s * STRIPE;
+		int stripe = s % BLOCK_STRIPES;
+		for (int i = 0; i < 8; i++) {
+			uint64_t v;
+			memcpy(&v, q + i * 8, 8);
+			uint64_t k = v ^ stripe_key(i, stripe);
+			acc[i ^ 1] += v;
+			acc[i] += (k & 0xffffffffull) * (k >> 32);
+		}
+		if (stripe == BLOCK_STRIPES - 1) {
+			for (int i = 0; i < 8; i++) {
+				uint64_t a = acc[i] ^ (acc[i] >> 47) ^ secret[i];
+				acc[i] = a * prime32_1;
+			}
+		}
+	}
+}
+
+#endif
+
+static inline uint64_t mix(uint64_t a, uint64_t b) {
+	// folded 128 bit product, as XXH3 merges its lanes
+	uint64_t al = a & 0xffffffffull, ah = a >> 32;
+	uint64_t bl = b & 0xffffffffull, bh = b >> 32;
+	uint64_t ll = al * bl, lh = al * bh, hl = ah * bl, hh = ah * bh;
+	uint64_t mid = (ll >> 32) + (lh & 0xffffffffull) + hl;
+	uint64_t lo = (mid << 32) | (ll & 0xffffffffull);
+	uint64_t hi = hh + (lh >> 32) + (mid >> 32);
+	return lo ^ hi;
+}
+
+uint64_t void_hash(const void *data, size_t len, uint64_t seed) {
+	const uint8_t *p = (const uint8_t *)data;
+	uint64_t acc[8] = {
+		prime32_1, prime64_1, prime64_2, prime64_3,
+		prime64_1 ^ seed, prime64_2 + seed, prime32_1, prime64_3 ^ seed,
+	};
+
+	size_t stripes = len / STRIPE;
+	hash_stripes(acc, p, stripes);
+	// the tail padded out to a whole stripe; the length goes into
+	// the result, so the padding is not ambiguous
+	size_t rest = len - stripes * STRIPE;
+	if (rest) {
+		uint8_t last[STRIPE] = { 0 };
+		memcpy(last, p + stripes * STRIPE, rest);
+		hash_stripes(acc, last, 1);
+	}
+
+	uint64_t h = len * prime64_1;
+	for (int i = 0; i < 8; i += 2) {
+		h += mix(acc[i] ^ secret[i], acc[i + 1] ^ secret[i + 1]);
+	}
+	h ^= h >> 37;
+	h *= 0x165667919e3779f9ull;
+	h ^= h >> 32;
+	return h ? h : 1;
+}
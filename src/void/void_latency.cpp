@@ -0,0 +1,87 @@
+/* void_latency.cpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+
+#include "void_latency.hpp"
+
+void void_latency::input(uint64_t arrival, uint64_t now) {
+	to_client.record(now - arrival);
+	std::lock_guard<std::mutex> lock(mutex);
+	// a client that never commits must not grow this forever
+	if (sent.size() < MAX_PENDING) {
+		sent.push_back(arrival);
+	}
+}
+
+void void_latency::commit(uint64_t now) {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto arrival : sent) {
+		to_commit.record(now - arrival);
+		if (committed.size() < MAX_PENDING) {
+			committed.push_back(pending_input{arrival, now});
+		}
+	}
+	sent.clear();
+}
+
+void void_latency::stage() {
+	std::lock_guard<std::mutex> lock(mutex);
+	staged.insert(staged.end(), committed.begin(), committed.end());
+	committed.clear();
+}
+
+void void_latency::present(uint64_t swap) {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto &&p : staged) {
+		to_present.record(swap - p.arrival);
+	}
+	staged.clear();
+}
+
+std::string void_latency::describe_header() {
+	char line[256];
+	snprintf(line, sizeof line,
+			"%-6s %8s %8s %8s %8s %8s %8s %8s %8s\n",
+			"CLIENT", "EVENTS", "SEND50", "COMMIT50", "COMMIT99",
+			"SHOW50", "SHOW90", "SHOW99", "SHOWMAX");
+	return line;
+}
+
+/* milliseconds */
+std::string void_latency::describe(uint32_t client_id) {
+	char line[256];
+	snprintf(line, sizeof line,
+			"%-6u %8llu %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f\n",
+			client_id,
+			(unsigned long long)to_client.get_count(),
+			to_client.quantile(0.5) / 1e6,
+			to_commit.quantile(0.5) / 1e6,
+			to_commit.quantile(0.99) / 1e6,
+			to_present.quantile(0.5) / 1e6,
+			to_present.quantile(0.9) / 1e6,
+			to_present.quantile(0.99) / 1e6,
+			to_present.get_max() / 1e6);
+	return line;
+}
+
@@ -0,0 +1,85 @@
+/* void_latency.hpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __VOID_LATENCY_HPP_
+#define __VOID_LATENCY_HPP_
+
+#include <stdint.h>
+
+#include <deque>
+#include <mutex>
+#include <string>
+
+#include "void_metrics.hpp"
+
+/**
+ * Input latency of one client.
+ *
+ * An input event is timestamped when the host delivers it to us and
+ * when we send it on to the client. It is matched to the first commit
+ * of the client after that, and to the swap of the first frame prepared
+ * after that commit, i.e. the one that shows it. Nested as we are, that
+ * swap is the closest we get to photons.
+ *
+ * input() runs on the render thread, commit() on the dispatch thread,
+ * stage() and present() on the render thread around each swap.
+ */
+class void_latency {
+private:
+	static const size_t MAX_PENDING = 256;
+
+	struct pending_input {
+		uint64_t arrival;
+		uint64_t commit;
+	};
+
+	std::mutex mutex;
+	/* sent, waiting for a commit */
+	std::deque<uint64_t> sent;
+	/* committed, waiting for a frame to pick the commit up */
+	std::deque<pending_input> committed;
+	/* in the frame being drawn */
+	std::deque<pending_input> staged;
+
+	void_histogram to_client;
+	void_histogram to_commit;
+	void_histogram to_present;
+
+public:
+	void input(uint64_t arrival, uint64_t now);
+	void commit(uint64_t now);
+	/* render thread, before preparing a frame */
+	void stage();
+	/* render thread, after the staged frame was swapped */
+	void present(uint64_t swap);
+
+	uint64_t get_count() {
+		return to_present.get_count();
+	}
+
+	std::string describe(uint32_t client_id);
+	static std::string describe_header();
+};
+
+#endif
+
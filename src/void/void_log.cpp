@@ -0,0 +1,342 @@
+/* void_log.cpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "void_log.hpp"
+
+uint32_t void_log_mask[LOG_TRACE + 1];
+
+namespace {
+
+const char *level_names[] = {
+	"error", "warn", "info", "debug", "trace",
+};
+
+const char *category_names[] = {
+	"core", "protocol", "surface", "frame",
+	"shell", "input", "render", "client",
+};
+
+const int RING_SIZE = 512;	/* power of two */
+const int TEXT_SIZE = 240;
+
+struct log_record {
+	uint64_t time;
+	int32_t tid;
+	uint8_t level;
+	uint8_t cat;
+	char text[TEXT_SIZE];
+};
+
+/* single producer, the owning thread, single consumer, the writer */
+struct log_ring {
+	log_record records[RING_SIZE];
+	std::atomic<uint32_t> head;
+	std::atomic<uint32_t> tail;
+	std::atomic<uint64_t> dropped;
+	uint64_t reported;
+	int32_t tid;
+
+	log_ring() : head(0), tail(0), dropped(0), reported(0) {
+		tid = syscall(SYS_gettid);
+	}
+};
+
+/* rings outlive their threads, there are only a handful of those */
+std::mutex ring_mutex;
+std::vector<log_ring *> ring_list;
+thread_local log_ring *local_ring = NULL;
+
+int level = LOG_INFO;
+uint32_t categories = (1u << LOG_CATEGORY_COUNT) - 1;
+std::mutex filter_mutex;
+
+std::atomic<bool> running(false);
+std::thread *writer = NULL;
+std::mutex writer_mutex;
+std::condition_variable writer_cond;
+bool stopping = false;
+FILE *out = stderr;
+std::mutex sync_mutex;
+std::atomic<uint64_t> written(0);
+
+uint64_t now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void update_mask() {
+	for (int l = 0; l <= LOG_TRACE; l++) {
+		__atomic_store_n(&void_log_mask[l], l <= level ? categories : 0,
+				__ATOMIC_RELAXED);
+	}
+}
+
+struct mask_init {
+	mask_init() {
+		update_mask();
+	}
+} mask_init_instance;
+
+log_ring *get_ring() {
+	if (!local_ring) {
+		local_ring = new log_ring;
+		std::lock_guard<std::mutex> lock(ring_mutex);
+		ring_list.push_back(local_ring);
+	}
+	return local_ring;
+}
+
+void print_record(FILE *f, const log_record &rec) {
+	fprintf(f, "%5llu.%06llu %-5s %-8s %d: %s\n",
+			(unsigned long long)(rec.time / 1000000000),
+			(unsigned long long)(rec.time % 1000000000 / 1000),
+			level_names[rec.level], category_names[rec.cat],
+			rec.tid, rec.text);
+}
+
+void drain() {
+	std::vector<log_record> batch;
+	std::vector<std::pair<log_ring *, uint64_t>> drops;
+	{
+		std::lock_guard<std::mutex> lock(ring_mutex);
+		for (auto r : ring_list) {
+			uint32_t tail = r->tail.load(std::memory_order_relaxed);
+			uint32_t head = r->head.load(std::memory_order_acquire);
+			for (; tail != head; tail++) {
+				batch.push_back(r->records[tail & (RING_SIZE - 1)]);
+			}
+			r->tail.store(tail, std::memory_order_release);
+			uint64_t dropped = r->dropped.load(std::memory_order_relaxed);
+			if (dropped != r->reported) {
+				drops.push_back(std::make_pair(r, dropped - r->reported));
+				r->reported = dropped;
+			}
+		}
+	}
+	if (batch.empty() && drops.empty()) {
+		return;
+	}
+	std::stable_sort(batch.begin(), batch.end(),
+			[](const log_record &a, const log_record &b) {
+				return a.time < b.time;
+			});
+	for (auto &&rec : batch) {
+		print_record(out, rec);
+	}
+	for (auto &&d : drops) {
+		fprintf(out, "log: thread %d dropped %llu messages\n",
+				d.first->tid, (unsigned long long)d.second);
+	}
+	fflush(out);
+	written += batch.size();
+}
+
+void run() {
+	std::unique_lock<std::mutex> lock(writer_mutex);
+	while (!stopping) {
+		writer_cond.wait_for(lock, std::chrono::milliseconds(20));
+		lock.unlock();
+		drain();
+		lock.lock();
+	}
+}
+
+}
+
+void void_log_write(int lvl, int cat, const char *fmt, ...) {
+	log_record tmp;
+	bool async = running.load(std::memory_order_acquire);
+	log_ring *r = NULL;
+	log_record *rec = &tmp;
+	uint32_t head = 0;
+
+	if (async) {
+		r = get_ring();
+		head = r->head.load(std::memory_order_relaxed);
+		if (head - r->tail.load(std::memory_order_acquire) >= RING_SIZE) {
+			r->dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		rec = &r->records[head & (RING_SIZE - 1)];
+	}
+
+	rec->time = now();
+	rec->tid = r ? r->tid : (int32_t)syscall(SYS_gettid);
+	rec->level = lvl;
+	rec->cat = cat;
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(rec->text, TEXT_SIZE, fmt, ap);
+	va_end(ap);
+
+	if (!async) {
+		std::lock_guard<std::mutex> lock(sync_mutex);
+		print_record(stderr, *rec);
+		return;
+	}
+
+	r->head.store(head + 1, std::memory_order_release);
+	if (lvl <= LOG_WARN) {
+		writer_cond.notify_one();
+	}
+}
+
+int void_log::start(const std::string &filename) {
+	if (writer) {
+		return 0;
+	}
+	if (!filename.empty()) {
+		FILE *f = fopen(filename.c_str(), "a");
+		if (!f) {
+			log_error(LOG_CORE, "log file %s: %s",
+					filename.c_str(), strerror(errno));
+			return -1;
+		}
+		out = f;
+	}
+	stopping = false;
+	writer = new std::thread(run);
+	running = true;
+	return 0;
+}
+
+void void_log::stop() {
+	if (!writer) {
+		return;
+	}
+	running = false;
+	{
+		std::lock_guard<std::mutex> lock(writer_mutex);
+		stopping = true;
+	}
+	writer_cond.notify_all();
+	writer->join();
+	delete writer;
+	writer = NULL;
+	drain();
+	if (out != stderr) {
+		fclose(out);
+		out = stderr;
+	}
+}
+
+int void_log::set_level(const std::string &name) {
+	for (int l = 0; l <= LOG_TRACE; l++) {
+		if (name == level_names[l]) {
+			std::lock_guard<std::mutex> lock(filter_mutex);
+			level = l;
+			update_mask();
+			return 0;
+		}
+	}
+	return -1;
+}
+
+int void_log::set_categories(const std::string &list) {
+	std::istringstream in(list);
+	std::string name;
+	uint32_t mask = 0;
+	while (std::getline(in, name, ',')) {
+		bool off = !name.empty() && name[0] == '-';
+		if (off) {
+			name.erase(0, 1);
+		}
+		uint32_t bits = 0;
+		if (name == "all") {
+			bits = (1u << LOG_CATEGORY_COUNT) - 1;
+		} else {
+			for (int c = 0; c < LOG_CATEGORY_COUNT; c++) {
+				if (name == category_names[c]) {
+					bits = 1u << c;
+				}
+			}
+			if (!bits) {
+				return -1;
+			}
+		}
+		mask = off ? mask & ~bits : mask | bits;
+	}
+	std::lock_guard<std::mutex> lock(filter_mutex);
+	categories = mask;
+	update_mask();
+	return 0;
+}
+
+std::string void_log::command(const std::string &args) {
+	std::istringstream in(args);
+	std::string what, value;
+	in >> what >> value;
+	if (what == "level") {
+		if (set_level(value) < 0) {
+			return "unknown level " + value + "\n";
+		}
+	} else if (what == "categories") {
+		if (set_categories(value) < 0) {
+			return "unknown category in " + value + "\n";
+		}
+	} else if (!what.empty()) {
+		return "usage: log [level <name> | categories <list>]\n";
+	}
+
+	std::string res;
+	uint64_t dropped = 0;
+	{
+		std::lock_guard<std::mutex> lock(filter_mutex);
+		res = std::string("level ") + level_names[level] +
+			" (compiled up to " + level_names[VOID_LOG_LEVEL] + ")\n";
+		res += "categories";
+		for (int c = 0; c < LOG_CATEGORY_COUNT; c++) {
+			if (categories & (1u << c)) {
+				res += std::string(" ") + category_names[c];
+			}
+		}
+		res += "\n";
+	}
+	{
+		std::lock_guard<std::mutex> lock(ring_mutex);
+		for (auto r : ring_list) {
+			dropped += r->dropped;
+		}
+	}
+	res += "written " + std::to_string(written) + "\n";
+	res += "dropped " + std::to_string(dropped) + "\n";
+	return res;
+}
+
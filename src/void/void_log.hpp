@@ -0,0 +1,103 @@
+/* void_log.hpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __VOID_LOG_HPP_
+#define __VOID_LOG_HPP_
+
+#include <stdint.h>
+
+#include <string>
+
+enum log_level {
+	LOG_ERROR,
+	LOG_WARN,
+	LOG_INFO,
+	LOG_DEBUG,
+	LOG_TRACE,
+};
+
+enum log_category {
+	LOG_CORE,
+	LOG_PROTOCOL,	/* global binds */
+	LOG_SURFACE,
+	LOG_FRAME,
+	LOG_SHELL,
+	LOG_INPUT,
+	LOG_RENDER,
+	LOG_CLIENT,
+	LOG_CATEGORY_COUNT,
+};
+
+/* levels above this are compiled out, make LOG_LEVEL=debug keeps debug */
+#ifndef VOID_LOG_LEVEL
+#define VOID_LOG_LEVEL LOG_INFO
+#endif
+
+/* arguments are not evaluated unless the message is going to be written */
+#define VOID_LOG(level, cat, ...) do { \
+	if ((level) <= VOID_LOG_LEVEL && void_log_enabled(level, cat)) { \
+		void_log_write(level, cat, __VA_ARGS__); \
+	} \
+} while (0)
+
+#define log_error(cat, ...) VOID_LOG(LOG_ERROR, cat, __VA_ARGS__)
+#define log_warn(cat, ...) VOID_LOG(LOG_WARN, cat, __VA_ARGS__)
+#define log_info(cat, ...) VOID_LOG(LOG_INFO, cat, __VA_ARGS__)
+#define log_debug(cat, ...) VOID_LOG(LOG_DEBUG, cat, __VA_ARGS__)
+#define log_trace(cat, ...) VOID_LOG(LOG_TRACE, cat, __VA_ARGS__)
+
+extern uint32_t void_log_mask[LOG_TRACE + 1];
+
+/* one bit per category for each level */
+static inline bool void_log_enabled(int level, int cat) {
+	return __atomic_load_n(&void_log_mask[level], __ATOMIC_RELAXED) &
+		(1u << cat);
+}
+
+void void_log_write(int level, int cat, const char *fmt, ...)
+	__attribute__((format(printf, 3, 4)));
+
+/**
+ * Log output.
+ *
+ * Messages are formatted on the calling thread into a ring owned by that
+ * thread, so writing one never blocks nor takes a lock. A writer thread
+ * drains all rings, orders the messages by time and writes them out.
+ * When a ring is full its messages are dropped and counted. Before
+ * start() and after stop() messages are written synchronously.
+ */
+namespace void_log {
+	int start(const std::string &filename);
+	void stop();
+
+	/* e.g. "debug" */
+	int set_level(const std::string &name);
+	/* comma separated, "all", or "all,-frame" */
+	int set_categories(const std::string &list);
+
+	/* the "log" control command */
+	std::string command(const std::string &args);
+}
+
+#endif
+
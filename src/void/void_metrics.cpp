@@ -0,0 +1,302 @@
+/* void_metrics.cpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <EGL/egl.h>
+
+#include "void_metrics.hpp"
+#include "void_log.hpp"
+#include "void_clock.hpp"
+
+void_histogram::void_histogram()
+	: count(0), sum(0), max(0)
+{
+	for (auto &&b : buckets) {
+		b = 0;
+	}
+}
+
+int void_histogram::index(uint64_t v) {
+	if (v < SUB_COUNT) {
+		return v;
+	}
+	int shift = 63 - __builtin_clzll(v) - SUB_BITS;
+	// the top SUB_BITS + 1 bits, the highest one always set
+	int mantissa = v >> shift;
+	return SUB_COUNT + shift * SUB_COUNT + mantissa - SUB_COUNT;
+}
+
+uint64_t void_histogram::value_at(int i) {
+	if (i < SUB_COUNT) {
+		return i;
+	}
+	int shift = (i - SUB_COUNT) / SUB_COUNT;
+	uint64_t mantissa = SUB_COUNT + (i - SUB_COUNT) % SUB_COUNT;
+	// middle of the bucket
+	return (mantissa << shift) + ((1ull << shift) >> 1);
+}
+
+void void_histogram::record(uint64_t v) {
+	buckets[index(v)].fetch_add(1, std::memory_order_relaxed);
+	count.fetch_add(1, std::memory_order_relaxed);
+	sum.fetch_add(v, std::memory_order_relaxed);
+	uint64_t m = max.load(std::memory_order_relaxed);
+	while (v > m && !max.compare_exchange_weak(m, v,
+				std::memory_order_relaxed)) {
+	}
+}
+
+void void_histogram::reset() {
+	for (auto &&b : buckets) {
+		b.store(0, std::memory_order_relaxed);
+	}
+	count = 0;
+	sum = 0;
+	max = 0;
+}
+
+uint64_t void_histogram::quantile(double q) {
+	uint64_t total = count.load(std::memory_order_relaxed);
+	if (!total) {
+		return 0;
+	}
+	uint64_t target = (uint64_t)(q * total + 0.5);
+	if (target < 1) {
+		target = 1;
+	}
+	uint64_t seen = 0;
+	for (int i = 0; i < BUCKET_COUNT; i++) {
+		seen += buckets[i].load(std::memory_order_relaxed);
+		if (seen >= target) {
+			uint64_t v = value_at(i);
+			return v < max ? v : max.load();
+		}
+	}
+	return max;
+}
+
+void void_histogram::write_prometheus(std::string &out, const char *name,
+		const char *help, double scale) {
+	static const double qs[] = { 0.5, 0.9, 0.99, 0.999 };
+	char line[256];
+
+	snprintf(line, sizeof line, "# HELP %s %s\n# TYPE %s summary\n",
+			name, help, name);
+	out += line;
+	for (double q : qs) {
+		snprintf(line, sizeof line, "%s{quantile=\"%g\"} %.9g\n",
+				name, q, quantile(q) / scale);
+		out += line;
+	}
+	snprintf(line, sizeof line,
+			"%s_sum %.9g\n"
+			"%s_count %llu\n",
+			name, sum / scale,
+			name, (unsigned long long)count.load());
+	out += line;
+}
+
+void_metrics::void_metrics()
+	: frames(0), dropped_frames(0),
+	upload_bytes(0), uploads(0), skipped_uploads(0), draw_calls(0),
+	refresh_period(1000000000ull / 60),
+	last_frame(0), cpu_start(0), cpu_time(0),
+	last_interval(0), last_cpu(0),
+	gpu_timer(false),
+	query_head(0), query_tail(0), query_active(false),
+	gen_queries(NULL), begin_query(NULL), end_query(NULL),
+	get_query_uiv(NULL), get_query_ui64v(NULL)
+{
+	memset(queries, 0, sizeof queries);
+}
+
+uint64_t void_metrics::now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void void_metrics::init_gpu_timer() {
+	const char *exts = (const char *)glGetString(GL_EXTENSIONS);
+	if (!exts || !strstr(exts, "GL_EXT_disjoint_timer_query")) {
+		log_info(LOG_RENDER, "no GL_EXT_disjoint_timer_query, "
+				"GPU frame time is not measured");
+		return;
+	}
+	gen_queries = (PFNGLGENQUERIESEXTPROC)
+		eglGetProcAddress("glGenQueriesEXT");
+	begin_query = (PFNGLBEGINQUERYEXTPROC)
+		eglGetProcAddress("glBeginQueryEXT");
+	end_query = (PFNGLENDQUERYEXTPROC)
+		eglGetProcAddress("glEndQueryEXT");
+	get_query_uiv = (PFNGLGETQUERYOBJECTUIVEXTPROC)
+		eglGetProcAddress("glGetQueryObjectuivEXT");
+	get_query_ui64v = (PFNGLGETQUERYOBJECTUI64VEXTPROC)
+		eglGetProcAddress("glGetQueryObjectui64vEXT");
+	if (!gen_queries || !begin_query || !end_query ||
+			!get_query_uiv || !get_query_ui64v) {
+		return;
+	}
+	gen_queries(QUERY_COUNT, queries);
+	gpu_timer = true;
+}
+
+void void_metrics::collect_gpu() {
+	uint64_t results[QUERY_COUNT];
+	int n = 0;
+	while (query_tail != query_head) {
+		GLuint q = queries[query_tail % QUERY_COUNT];
+		GLuint available = 0;
+		get_query_uiv(q, GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+		if (!available) {
+			break;
+		}
+		GLuint64 elapsed = 0;
+		get_query_ui64v(q, GL_QUERY_RESULT_EXT, &elapsed);
+		results[n++] = elapsed;
+		query_tail++;
+	}
+
+	// a disjoint operation, e.g. a clock change, voids the results
+	GLint disjoint = 0;
+	glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+	if (disjoint) {
+		return;
+	}
+	for (int i = 0; i < n; i++) {
+		frame_gpu.record(results[i]);
+	}
+}
+
+void void_metrics::begin_frame() {
+	// the frame clock, which a simulation steps
+	uint64_t t = void_clock::now();
+	if (last_frame) {
+		uint64_t interval = t - last_frame;
+		frame_interval.record(interval);
+		last_interval = interval;
+		// longer pauses mean the host stopped asking for frames,
+		// e.g. our window is hidden, not that we were late
+		if (refresh_period && interval > refresh_period * 3 / 2 &&
+				interval < 1000000000ull) {
+			dropped_frames += (interval + refresh_period / 2) /
+				refresh_period - 1;
+		}
+	}
+	last_frame = t;
+	cpu_time = 0;
+}
+
+void void_metrics::begin_gpu() {
+	if (!gpu_timer) {
+		return;
+	}
+	collect_gpu();
+	if (query_head - query_tail >= QUERY_COUNT) {
+		// the GPU is far behind, skip timing this frame
+		query_active = false;
+		return;
+	}
+	begin_query(GL_TIME_ELAPSED_EXT, queries[query_head % QUERY_COUNT]);
+	query_active = true;
+}
+
+void void_metrics::end_gpu() {
+	if (!query_active) {
+		return;
+	}
+	end_query(GL_TIME_ELAPSED_EXT);
+	query_head++;
+	query_active = false;
+}
+
+void void_metrics::end_frame() {
+	frame_cpu.record(cpu_time);
+	last_cpu = cpu_time;
+	frames.fetch_add(1, std::memory_order_relaxed);
+}
+
+void void_metrics::reset() {
+	frame_interval.reset();
+	frame_cpu.reset();
+	frame_gpu.reset();
+	frames = 0;
+	dropped_frames = 0;
+	upload_bytes = 0;
+	uploads = 0;
+	skipped_uploads = 0;
+	draw_calls = 0;
+}
+
+std::string void_metrics::describe_prometheus() {
+	std::string out;
+	char line[256];
+
+	frame_interval.write_prometheus(out, "void_frame_interval_seconds",
+			"Time between the starts of consecutive frames.", 1e9);
+	frame_cpu.write_prometheus(out, "void_frame_cpu_seconds",
+			"CPU time spent composing a frame.", 1e9);
+	frame_gpu.write_prometheus(out, "void_frame_gpu_seconds",
+			"GPU time spent drawing a frame.", 1e9);
+
+	snprintf(line, sizeof line,
+			"# HELP void_frames_total Frames drawn.\n"
+			"# TYPE void_frames_total counter\n"
+			"void_frames_total %llu\n"
+			"# HELP void_frames_dropped_total Refresh cycles missed.\n"
+			"# TYPE void_frames_dropped_total counter\n"
+			"void_frames_dropped_total %llu\n",
+			(unsigned long long)frames.load(),
+			(unsigned long long)dropped_frames.load());
+	out += line;
+	snprintf(line, sizeof line,
+			"# HELP void_uploads_total Texture uploads.\n"
+			"# TYPE void_uploads_total counter\n"
+			"void_uploads_total %llu\n"
+			"# HELP void_upload_bytes_total Bytes uploaded to textures.\n"
+			"# TYPE void_upload_bytes_total counter\n"
+			"void_upload_bytes_total %llu\n"
+			"# HELP void_uploads_skipped_total Commits of content "
+			"already in the texture.\n"
+			"# TYPE void_uploads_skipped_total counter\n"
+			"void_uploads_skipped_total %llu\n",
+			(unsigned long long)uploads.load(),
+			(unsigned long long)upload_bytes.load(),
+			(unsigned long long)skipped_uploads.load());
+	out += line;
+	snprintf(line, sizeof line,
+			"# HELP void_draw_calls_total Draw calls issued.\n"
+			"# TYPE void_draw_calls_total counter\n"
+			"void_draw_calls_total %llu\n"
+			"# HELP void_gpu_timer GPU frame time is measured.\n"
+			"# TYPE void_gpu_timer gauge\n"
+			"void_gpu_timer %d\n",
+			(unsigned long long)draw_calls.load(),
+			gpu_timer ? 1 : 0);
+	out += line;
+	return out;
+}
+
@@ -0,0 +1,179 @@
+/* void_metrics.hpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __VOID_METRICS_HPP_
+#define __VOID_METRICS_HPP_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+/**
+ * Log-linear histogram in the style of HdrHistogram.
+ *
+ * Each power of two is split into 32 linear sub-buckets, so any value is
+ * reported within about 3% over the whole 64 bit range with a fixed
+ * amount of memory. Recording is a couple of relaxed atomic adds and
+ * may run concurrently with reading.
+ */
+class void_histogram {
+private:
+	static const int SUB_BITS = 5;
+	static const int SUB_COUNT = 1 << SUB_BITS;
+	static const int BUCKET_COUNT = SUB_COUNT * (64 - SUB_BITS + 1);
+
+	std::atomic<uint64_t> buckets[BUCKET_COUNT];
+	std::atomic<uint64_t> count;
+	std::atomic<uint64_t> sum;
+	std::atomic<uint64_t> max;
+
+	static int index(uint64_t v);
+	static uint64_t value_at(int i);
+
+public:
+	void_histogram();
+
+	void record(uint64_t v);
+	uint64_t quantile(double q);
+	/* not atomic as a whole, records racing with it may be lost */
+	void reset();
+
+	uint64_t get_count() {
+		return count;
+	}
+	uint64_t get_sum() {
+		return sum;
+	}
+	uint64_t get_max() {
+		return max;
+	}
+
+	/* as a Prometheus summary, values are divided by scale */
+	void write_prometheus(std::string &out, const char *name,
+			const char *help, double scale);
+};
+
+/**
+ * Frame timing and throughput counters of the compositor.
+ *
+ * The render thread records into it, the control thread exports it in
+ * the Prometheus text format. GPU time is measured with
+ * GL_EXT_disjoint_timer_query when the render context has it; results
+ * are read back a few frames later without waiting on the GPU.
+ */
+class void_metrics {
+private:
+	static const int QUERY_COUNT = 4;
+
+	void_histogram frame_interval;
+	void_histogram frame_cpu;
+	void_histogram frame_gpu;
+
+	std::atomic<uint64_t> frames;
+	std::atomic<uint64_t> dropped_frames;
+	std::atomic<uint64_t> upload_bytes;
+	std::atomic<uint64_t> uploads;
+	std::atomic<uint64_t> skipped_uploads;
+	std::atomic<uint64_t> draw_calls;
+
+	uint64_t refresh_period;
+	uint64_t last_frame;
+	uint64_t cpu_start;
+	uint64_t cpu_time;
+	/* of the last complete frame */
+	uint64_t last_interval;
+	uint64_t last_cpu;
+
+	bool gpu_timer;
+	GLuint queries[QUERY_COUNT];
+	int query_head, query_tail;
+	bool query_active;
+	PFNGLGENQUERIESEXTPROC gen_queries;
+	PFNGLBEGINQUERYEXTPROC begin_query;
+	PFNGLENDQUERYEXTPROC end_query;
+	PFNGLGETQUERYOBJECTUIVEXTPROC get_query_uiv;
+	PFNGLGETQUERYOBJECTUI64VEXTPROC get_query_ui64v;
+
+	void collect_gpu();
+
+public:
+	void_metrics();
+
+	static uint64_t now();
+
+	void set_refresh_rate(int hz) {
+		refresh_period = hz > 0 ? 1000000000ull / hz : 0;
+	}
+	uint64_t get_refresh_period() {
+		return refresh_period;
+	}
+
+	/* render thread, with the render context current */
+	void init_gpu_timer();
+
+	/* render thread, once per frame in this order */
+	void begin_frame();
+	void begin_gpu();
+	void end_gpu();
+	void end_frame();
+
+	/* bracket the CPU work of composing a frame, may nest in a frame */
+	void begin_cpu() {
+		cpu_start = now();
+	}
+	void end_cpu() {
+		cpu_time += now() - cpu_start;
+	}
+
+	void add_upload(uint64_t bytes) {
+		uploads.fetch_add(1, std::memory_order_relaxed);
+		upload_bytes.fetch_add(bytes, std::memory_order_relaxed);
+	}
+	/* a commit whose content was already in the texture */
+	void add_skipped_upload() {
+		skipped_uploads.fetch_add(1, std::memory_order_relaxed);
+	}
+	void add_draw_call() {
+		draw_calls.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/* render thread */
+	uint64_t get_last_interval() {
+		return last_interval;
+	}
+	uint64_t get_last_cpu() {
+		return last_cpu;
+	}
+
+	/* starts a new measurement period, e.g. for a benchmark */
+	void reset();
+
+	std::string describe_prometheus();
+};
+
+#endif
+
@@ -0,0 +1,199 @@
+/* void_probe.cpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Input latency probe.
+ *
+ * A window that turns from black to white, or back, on every button
+ * press. It reports the time from receiving the press to the frame
+ * callback of the frame that shows the flash; the compositor reports
+ * its side with the "latency" control command. Clicks can come from a
+ * person, or from whatever drives the host seat in an automated run,
+ * and a camera or light sensor can watch the flash.
+ *
+ * usage: void_probe [clicks]	exit with a summary after that many
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include <wayland-util.hpp>
+#include <wayland-client.hpp>
+
+#include "void_shm.hpp"
+
+using namespace wayland;
+
+#define WIDTH 256
+#define HEIGHT 256
+
+static uint64_t now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+class probe_t {
+private:
+	display_client_t display;
+	registry_proxy_t registry;
+	compositor_proxy_t compositor;
+	shell_proxy_t shell;
+	seat_proxy_t seat;
+	shm_proxy_t shm;
+
+	surface_proxy_t surface;
+	shell_surface_proxy_t shell_surface;
+	pointer_proxy_t pointer;
+	callback_proxy_t frame_cb;
+
+	/* black and white */
+	buffer_proxy_t buffers[2];
+	int shown;
+
+	bool waiting;
+	uint64_t press_time;
+	std::vector<uint64_t> samples;
+	size_t clicks;
+
+	void flash() {
+		shown = !shown;
+		surface.attach(buffers[shown], 0, 0);
+		surface.damage(0, 0, WIDTH, HEIGHT);
+		frame_cb = surface.frame();
+		frame_cb.on_done() = [&](uint32_t) {
+			if (!waiting) {
+				return;
+			}
+			waiting = false;
+			uint64_t latency = now() - press_time;
+			samples.push_back(latency);
+			printf("click %zu: %.2f ms\n", samples.size(),
+					latency / 1e6);
+			fflush(stdout);
+		};
+		surface.commit();
+	}
+
+public:
+	probe_t(size_t n)
+		: shown(0), waiting(false), press_time(0), clicks(n)
+	{
+		registry = display.get_registry();
+		registry.on_global() = [&](uint32_t name, std::string interface,
+				uint32_t version) {
+			if (interface == "wl_compositor")
+				registry.bind(name, compositor, version);
+			else if (interface == "wl_shell")
+				registry.bind(name, shell, version);
+			else if (interface == "wl_seat")
+				registry.bind(name, seat, version);
+			else if (interface == "wl_shm")
+				registry.bind(name, shm, version);
+		};
+		display.roundtrip();
+		if (!compositor || !shell || !seat || !shm) {
+			throw std::runtime_error("missing globals");
+		}
+
+		size_t size = WIDTH * HEIGHT * 4;
+		int fd = void_create_shm_file("void-probe", size * 2);
+		void *mem = mmap(NULL, size * 2, PROT_READ | PROT_WRITE,
+				MAP_SHARED, fd, 0);
+		if (mem == MAP_FAILED) {
+			throw std::runtime_error("mmap");
+		}
+		memset(mem, 0, size);
+		memset((char *)mem + size, 0xff, size);
+		auto pool = shm.create_pool(fd, size * 2);
+		for (int i = 0; i < 2; i++) {
+			buffers[i] = pool.create_buffer(i * size, WIDTH, HEIGHT,
+					WIDTH * 4, shm_format::xrgb8888);
+		}
+		close(fd);
+
+		surface = compositor.create_surface();
+		shell_surface = shell.get_shell_surface(surface);
+		shell_surface.on_ping() = [&](uint32_t serial) {
+			shell_surface.pong(serial);
+		};
+		shell_surface.set_title("latency probe");
+		shell_surface.set_class("void-probe");
+		shell_surface.set_toplevel();
+
+		pointer = seat.get_pointer();
+		pointer.on_button() = [&](uint32_t serial, uint32_t time,
+				uint32_t button, pointer_button_state state) {
+			if (state != pointer_button_state::pressed) {
+				return;
+			}
+			press_time = now();
+			waiting = true;
+			flash();
+		};
+
+		surface.attach(buffers[shown], 0, 0);
+		surface.damage(0, 0, WIDTH, HEIGHT);
+		surface.commit();
+	}
+
+	void run() {
+		while (display.dispatch() >= 0) {
+			if (clicks && samples.size() >= clicks) {
+				break;
+			}
+		}
+	}
+
+	void summary() {
+		if (samples.empty()) {
+			return;
+		}
+		std::sort(samples.begin(), samples.end());
+		auto pct = [&](double q) {
+			return samples[(size_t)(q * (samples.size() - 1))] / 1e6;
+		};
+		printf("%zu clicks, ms: p50 %.2f p90 %.2f p99 %.2f max %.2f\n",
+				samples.size(), pct(0.5), pct(0.9), pct(0.99),
+				samples.back() / 1e6);
+	}
+};
+
+int main(int argc, char *argv[]) {
+	size_t clicks = argc > 1 ? strtoul(argv[1], NULL, 10) : 0;
+
+	probe_t probe(clicks);
+	probe.run();
+	probe.summary();
+
+	return 0;
+}
+
@@ -0,0 +1,115 @@
+/* void_qos.cpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+
+#include "void_qos.hpp"
+#include "void_config.hpp"
+#include "void_clock.hpp"
+
+static const char *priority_names[QOS_PRIORITIES] = {
+	"focused", "background", "occluded",
+};
+
+void_qos::void_qos()
+	: config(NULL), uploads_deferred(0)
+{
+	for (int i = 0; i < QOS_PRIORITIES; i++) {
+		defaults.frame_rate[i] = 0;
+		defaults.upload_rate[i] = 0;
+	}
+	defaults.frame_rate[QOS_OCCLUDED] = 1;
+}
+
+void void_qos::fill(qos_policy &p, const std::string &section,
+		const qos_policy &def) {
+	for (int i = 0; i < QOS_PRIORITIES; i++) {
+		std::string name = priority_names[i];
+		p.frame_rate[i] = config->get_int(section + name + "_frame_rate",
+				def.frame_rate[i]);
+		p.upload_rate[i] = i == QOS_OCCLUDED ? 0 :
+			config->get_int(section + name + "_upload_rate",
+					def.upload_rate[i]);
+	}
+}
+
+void void_qos::load(const void_config &c) {
+	std::lock_guard<std::mutex> lock(mutex);
+	config = &c;
+	qos_policy builtin = defaults;
+	fill(defaults, "qos.", builtin);
+	policy_dict.clear();
+}
+
+const qos_policy *void_qos::lookup(const std::string &app_id) {
+	if (app_id.empty() || !config) {
+		return &defaults;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = policy_dict.find(app_id);
+	if (it != policy_dict.end()) {
+		return &it->second;
+	}
+	qos_policy &p = policy_dict[app_id];
+	p.app_id = app_id;
+	fill(p, "qos." + app_id + ".", defaults);
+	return &p;
+}
+
+bool void_qos::allows(int hz, uint64_t now, uint64_t last) {
+	if (hz <= 0) {
+		return true;
+	}
+	// half a frame of slack, or 10 Hz on a 60 Hz output becomes 8.6 Hz
+	uint64_t period = 1000000000ull / hz;
+	uint64_t slack = void_clock::get_frame_period() / 2;
+	return now - last + slack >= period;
+}
+
+std::string void_qos::describe(const std::string &) {
+	char line[256];
+	snprintf(line, sizeof line,
+			"uploads_deferred %llu\n"
+			"%-20s %10s %10s %10s %10s %10s\n",
+			(unsigned long long)uploads_deferred,
+			"APP", "FOCUS FPS", "BG FPS", "HIDDEN FPS",
+			"FOCUS UP/s", "BG UP/s");
+	std::string out = line;
+
+	auto format = [&](const char *name, const qos_policy &p) {
+		snprintf(line, sizeof line,
+				"%-20s %10d %10d %10d %10d %10d\n", name,
+				p.frame_rate[QOS_FOCUSED], p.frame_rate[QOS_BACKGROUND],
+				p.frame_rate[QOS_OCCLUDED],
+				p.upload_rate[QOS_FOCUSED],
+				p.upload_rate[QOS_BACKGROUND]);
+		out += line;
+	};
+	std::lock_guard<std::mutex> lock(mutex);
+	format("(default)", defaults);
+	for (auto &&p : policy_dict) {
+		format(p.first.c_str(), p.second);
+	}
+	return out;
+}
+
@@ -0,0 +1,97 @@
+/* void_qos.hpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __VOID_QOS_HPP_
+#define __VOID_QOS_HPP_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+
+class void_config;
+
+enum qos_priority {
+	QOS_FOCUSED,
+	QOS_BACKGROUND,
+	/* covered or off-screen */
+	QOS_OCCLUDED,
+	QOS_PRIORITIES,
+};
+
+/*
+ * Per second, 0 for no limit; occluded surfaces get no frames at 0, and
+ * no uploads at all since they are not drawn.
+ */
+struct qos_policy {
+	std::string app_id;
+	int frame_rate[QOS_PRIORITIES];
+	int upload_rate[QOS_PRIORITIES];
+};
+
+/**
+ * Frame callback and upload rates by surface priority.
+ *
+ * The defaults come from the [qos] section, and an app can have its own
+ * in a [qos.<app id>] section with the same keys. Policies are resolved
+ * once per app id and live as long as the compositor, so surfaces keep
+ * a plain pointer to theirs.
+ */
+class void_qos {
+private:
+	const void_config *config;
+	std::mutex mutex;
+	qos_policy defaults;
+	std::map<std::string, qos_policy> policy_dict;
+
+	std::atomic<uint64_t> uploads_deferred;
+
+	void fill(qos_policy &p, const std::string &section,
+			const qos_policy &def);
+
+public:
+	void_qos();
+
+	void load(const void_config &c);
+
+	/* the default policy for an empty app id */
+	const qos_policy *lookup(const std::string &app_id);
+	const qos_policy *get_default() {
+		return &defaults;
+	}
+
+	/* whether something limited to hz may happen again at now */
+	bool allows(int hz, uint64_t now, uint64_t last);
+
+	void count_upload_deferred() {
+		uploads_deferred.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/* the "qos" control command */
+	std::string describe(const std::string &args);
+};
+
+#endif
+
@@ -0,0 +1,300 @@
+/* void_record.cpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+#include <sstream>
+
+#include <zlib.h>
+
+#include "void_record.hpp"
+#include "void_log.hpp"
+#include "void_metrics.hpp"
+#include "void_hash.hpp"
+
+void_recorder::void_recorder()
+	: active(false), file(NULL), start_time(0),
+	records(0), commits(0), content_bytes(0), stored_bytes(0), file_bytes(0)
+{
+}
+
+void_recorder::~void_recorder() {
+	stop();
+}
+
+int void_recorder::start(const std::string &filename) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (file) {
+		return -1;
+	}
+	file = fopen(filename.c_str(), "wb");
+	if (!file) {
+		log_error(LOG_CORE, "record: %s: %s", filename.c_str(),
+				strerror(errno));
+		return -1;
+	}
+	setvbuf(file, NULL, _IOFBF, 1 << 20);
+	fwrite(VOID_RECORD_MAGIC, 1, 8, file);
+
+	path = filename;
+	start_time = void_metrics::now();
+	chunk_dict.clear();
+	known_surfaces.clear();
+	records = commits = content_bytes = stored_bytes = 0;
+	file_bytes = 8;
+	active = true;
+	log_info(LOG_CORE, "recording to %s", path.c_str());
+	return 0;
+}
+
+void void_recorder::stop() {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!file) {
+		return;
+	}
+	active = false;
+	fclose(file);
+	file = NULL;
+	log_info(LOG_CORE, "recorded %llu commits to %s, %llu MB of content "
+			"stored in %llu MB",
+			(unsigned long long)commits, path.c_str(),
+			(unsigned long long)(content_bytes >> 20),
+			(unsigned long long)(file_bytes >> 20));
+}
+
+/* with mutex held */
+void void_recorder::write(rec_type type, uint32_t client, uint32_t surface,
+		const void *payload, uint32_t size,
+		const void *extra, uint32_t extra_size) {
+	rec_header h;
+	memset(&h, 0, sizeof h);
+	h.type = type;
+	h.client = client;
+	h.surface = surface;
+	h.size = size + extra_size;
+	h.time = void_metrics::now() - start_time;
+
+	fwrite(&h, sizeof h, 1, file);
+	if (size) {
+		fwrite(payload, 1, size, file);
+	}
+	if (extra_size) {
+		fwrite(extra, 1, extra_size, file);
+	}
+	records++;
+	file_bytes += sizeof h + h.size;
+}
+
+/* with mutex held; surfaces from before the recording show up lazily */
+void void_recorder::introduce(uint32_t client, uint32_t surface) {
+	if (known_surfaces.insert(std::make_pair(client, surface)).second) {
+		write(REC_SURFACE, client, surface, NULL, 0);
+	}
+}
+
+/* with mutex held */
+uint32_t void_recorder::store_chunk(const uint8_t *data, uint32_t size) {
+	uint64_t hash = void_hash(data, size);
+	auto it = chunk_dict.find(hash);
+	if (it != chunk_dict.end()) {
+		return it->second;
+	}
+
+	rec_chunk c;
+	c.id = chunk_dict.size();
+	c.raw_size = size;
+	chunk_dict[hash] = c.id;
+
+	uLongf zsize = compressBound(size);
+	zbuf.resize(zsize);
+	// level 1, recording must keep up with the clients
+	if (compress2(zbuf.data(), &zsize, data, size, 1) == Z_OK &&
+			zsize < size) {
+		write(REC_CHUNK, 0, 0, &c, sizeof c, zbuf.data(), zsize);
+	} else {
+		write(REC_CHUNK, 0, 0, &c, sizeof c, data, size);
+		zsize = size;
+	}
+	stored_bytes += zsize;
+	return c.id;
+}
+
+void void_recorder::client_gone(uint32_t client) {
+	if (!is_active()) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!file) {
+		return;
+	}
+	for (auto it = known_surfaces.begin(); it != known_surfaces.end(); ) {
+		if (it->first == client) {
+			it = known_surfaces.erase(it);
+		} else {
+			++it;
+		}
+	}
+	write(REC_CLIENT_GONE, client, 0, NULL, 0);
+}
+
+void void_recorder::surface_gone(uint32_t client, uint32_t surface) {
+	if (!is_active()) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!file ||
+			!known_surfaces.erase(std::make_pair(client, surface))) {
+		return;
+	}
+	write(REC_SURFACE_GONE, client, surface, NULL, 0);
+}
+
+void void_recorder::title(uint32_t client, uint32_t surface,
+		const std::string &s) {
+	if (!is_active()) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!file) {
+		return;
+	}
+	introduce(client, surface);
+	write(REC_TITLE, client, surface, s.data(), s.size());
+}
+
+void void_recorder::app_id(uint32_t client, uint32_t surface,
+		const std::string &s) {
+	if (!is_active()) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!file) {
+		return;
+	}
+	introduce(client, surface);
+	write(REC_APP_ID, client, surface, s.data(), s.size());
+}
+
+void void_recorder::buffer(uint32_t client, uint32_t surface,
+		const rec_buffer &b, const void *data, size_t size) {
+	if (!is_active()) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!file) {
+		return;
+	}
+	introduce(client, surface);
+
+	const uint8_t *p = (const uint8_t *)data;
+	ids.clear();
+	for (size_t off = 0; off < size; off += VOID_RECORD_CHUNK) {
+		uint32_t n = std::min<size_t>(VOID_RECORD_CHUNK, size - off);
+		ids.push_back(store_chunk(p + off, n));
+	}
+	content_bytes += size;
+	write(REC_BUFFER, client, surface, &b, sizeof b,
+			ids.data(), ids.size() * sizeof ids[0]);
+}
+
+void void_recorder::damage(uint32_t client, uint32_t surface,
+		int32_t x, int32_t y, int32_t width, int32_t height) {
+	if (!is_active()) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!file) {
+		return;
+	}
+	int32_t box[4] = { x, y, width, height };
+	introduce(client, surface);
+	write(REC_DAMAGE, client, surface, box, sizeof box);
+}
+
+void void_recorder::frame(uint32_t client, uint32_t surface) {
+	if (!is_active()) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!file) {
+		return;
+	}
+	introduce(client, surface);
+	write(REC_FRAME, client, surface, NULL, 0);
+}
+
+void void_recorder::commit(uint32_t client, uint32_t surface) {
+	if (!is_active()) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!file) {
+		return;
+	}
+	introduce(client, surface);
+	write(REC_COMMIT, client, surface, NULL, 0);
+	commits++;
+}
+
+std::string void_recorder::command(const std::string &args) {
+	std::istringstream in(args);
+	std::string what, filename;
+	in >> what >> filename;
+	if (what == "start") {
+		if (filename.empty()) {
+			filename = "/tmp/void-record.bin";
+		}
+		if (start(filename) < 0) {
+			return "could not start recording to " + filename + "\n";
+		}
+		return "recording to " + filename + "\n";
+	} else if (what == "stop") {
+		stop();
+		return "stopped\n";
+	} else if (!what.empty()) {
+		return "usage: record [start [file] | stop]\n";
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!file) {
+		return "not recording\n";
+	}
+	char out[512];
+	snprintf(out, sizeof out,
+			"recording to %s\n"
+			"records %llu\n"
+			"commits %llu\n"
+			"content_bytes %llu\n"
+			"stored_bytes %llu\n"
+			"chunks %zu\n",
+			path.c_str(),
+			(unsigned long long)records,
+			(unsigned long long)commits,
+			(unsigned long long)content_bytes,
+			(unsigned long long)stored_bytes,
+			chunk_dict.size());
+	return out;
+}
+
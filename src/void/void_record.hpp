@@ -0,0 +1,141 @@
+/* void_record.hpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __VOID_RECORD_HPP_
+#define __VOID_RECORD_HPP_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*
+ * Trace file: the magic, then records of a rec_header and size bytes
+ * of payload, little endian as written by the host.
+ */
+#define VOID_RECORD_MAGIC "VOIDREC1"
+
+/* buffer contents are split in chunks of this size and stored once each */
+#define VOID_RECORD_CHUNK (16 << 10)
+
+enum rec_type {
+	REC_CLIENT_GONE = 1,
+	REC_SURFACE,		/* a surface shown as a toplevel */
+	REC_SURFACE_GONE,
+	REC_TITLE,		/* payload: the string */
+	REC_APP_ID,
+	REC_CHUNK,		/* rec_chunk, then the maybe compressed bytes */
+	REC_BUFFER,		/* rec_buffer, then chunk ids, attached at commit */
+	REC_DAMAGE,		/* int32_t x, y, width, height */
+	REC_FRAME,
+	REC_COMMIT,
+};
+
+struct rec_header {
+	uint8_t type;
+	uint8_t pad[3];
+	uint32_t client;
+	uint32_t surface;
+	uint32_t size;
+	/* ns since the recording started */
+	uint64_t time;
+};
+
+struct rec_chunk {
+	uint32_t id;
+	/* compressed with zlib if smaller than raw_size */
+	uint32_t raw_size;
+};
+
+struct rec_buffer {
+	int32_t x, y;
+	int32_t width, height, stride;
+	uint32_t format;
+};
+
+/**
+ * Records what clients ask of the compositor, for replaying the same
+ * traffic later without the applications.
+ *
+ * Calls come from the dispatch thread, start and stop from the control
+ * socket. Buffer contents are taken at commit, split in chunks that are
+ * deduplicated by hash and compressed, so that a window repainting a
+ * few rows costs the file a few chunks.
+ */
+class void_recorder {
+private:
+	std::mutex mutex;
+	std::atomic<bool> active;
+	FILE *file;
+	std::string path;
+	uint64_t start_time;
+
+	/* content hash -> chunk id */
+	std::unordered_map<uint64_t, uint32_t> chunk_dict;
+	std::set<std::pair<uint32_t, uint32_t>> known_surfaces;
+	std::vector<uint8_t> zbuf;
+	std::vector<uint32_t> ids;
+
+	uint64_t records, commits, content_bytes, stored_bytes, file_bytes;
+
+	void write(rec_type type, uint32_t client, uint32_t surface,
+			const void *payload, uint32_t size,
+			const void *extra = NULL, uint32_t extra_size = 0);
+	void introduce(uint32_t client, uint32_t surface);
+	uint32_t store_chunk(const uint8_t *data, uint32_t size);
+
+public:
+	void_recorder();
+	~void_recorder();
+
+	bool is_active() {
+		return active.load(std::memory_order_relaxed);
+	}
+
+	int start(const std::string &filename);
+	void stop();
+
+	void client_gone(uint32_t client);
+	void surface_gone(uint32_t client, uint32_t surface);
+	void title(uint32_t client, uint32_t surface, const std::string &s);
+	void app_id(uint32_t client, uint32_t surface, const std::string &s);
+	/* size covers every plane of the buffer, see void_format */
+	void buffer(uint32_t client, uint32_t surface, const rec_buffer &b,
+			const void *data, size_t size);
+	void damage(uint32_t client, uint32_t surface,
+			int32_t x, int32_t y, int32_t width, int32_t height);
+	void frame(uint32_t client, uint32_t surface);
+	void commit(uint32_t client, uint32_t surface);
+
+	/* the "record" control command */
+	std::string command(const std::string &args);
+};
+
+#endif
+
@@ -0,0 +1,442 @@
+/* void_replay.cpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Replays a trace written by the "record" control command.
+ *
+ * usage: void_replay [-f] [-s speed] <trace>
+ *
+ * Every recorded client gets its own connection and every surface a
+ * wl_shell toplevel, then requests are sent again with the recorded
+ * buffer contents, at the recorded pace (scaled by speed) or as fast as
+ * the compositor takes them with -f.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include <wayland-util.hpp>
+#include <wayland-client.hpp>
+
+#include "void_record.hpp"
+#include "void_shm.hpp"
+
+using namespace wayland;
+
+/* buffers a surface may have in flight before waiting for a release */
+#define MAX_BUFFERS 3
+
+static uint64_t now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+struct replay_buffer {
+	shm_pool_proxy_t pool;
+	buffer_proxy_t buffer;
+	uint8_t *mem;
+	size_t size;
+	rec_buffer geometry;
+	bool busy;
+
+	~replay_buffer() {
+		if (mem) {
+			munmap(mem, size);
+		}
+	}
+};
+
+struct replay_frame {
+	callback_proxy_t callback;
+	bool done;
+};
+
+struct replay_surface {
+	surface_proxy_t surface;
+	shell_surface_proxy_t shell_surface;
+	std::list<replay_buffer> buffers;
+	/* frame callbacks, answered ones are dropped on the next request */
+	std::list<replay_frame> frames;
+};
+
+struct replay_client {
+	display_client_t display;
+	registry_proxy_t registry;
+	compositor_proxy_t compositor;
+	shell_proxy_t shell;
+	shm_proxy_t shm;
+	std::map<uint32_t, std::unique_ptr<replay_surface>> surfaces;
+	uint64_t commits;
+
+	replay_client() : commits(0) {
+		registry = display.get_registry();
+		registry.on_global() = [&](uint32_t name, std::string interface,
+				uint32_t version) {
+			if (interface == "wl_compositor")
+				registry.bind(name, compositor, version);
+			else if (interface == "wl_shell")
+				registry.bind(name, shell, version);
+			else if (interface == "wl_shm")
+				registry.bind(name, shm, version);
+		};
+		display.roundtrip();
+		if (!compositor || !shell || !shm) {
+			throw std::runtime_error("missing globals");
+		}
+	}
+
+	/* sends what is queued and handles whatever arrived, without blocking */
+	void pump() {
+		while (display.prepare_read() != 0) {
+			display.dispatch_pending();
+		}
+		display.flush();
+		pollfd p = { display.get_fd(), POLLIN, 0 };
+		if (poll(&p, 1, 0) > 0) {
+			display.read_events();
+		} else {
+			display.cancel_read();
+		}
+		display.dispatch_pending();
+	}
+};
+
+class replayer {
+private:
+	std::map<uint32_t, std::unique_ptr<replay_client>> clients;
+	std::vector<std::vector<uint8_t>> chunks;
+	uint64_t records, commits, content_bytes, frames_done;
+
+	replay_client *get_client(uint32_t id) {
+		auto &c = clients[id];
+		if (!c) {
+			c.reset(new replay_client());
+		}
+		return c.get();
+	}
+
+	replay_surface *get_surface(uint32_t client, uint32_t id) {
+		replay_client *c = get_client(client);
+		auto &s = c->surfaces[id];
+		if (!s) {
+			s.reset(new replay_surface());
+			replay_surface *p = s.get();
+			p->surface = c->compositor.create_surface();
+			p->shell_surface = c->shell.get_shell_surface(p->surface);
+			p->shell_surface.on_ping() = [p](uint32_t serial) {
+				p->shell_surface.pong(serial);
+			};
+			p->shell_surface.set_toplevel();
+		}
+		return s.get();
+	}
+
+	replay_buffer *get_buffer(replay_client *c, replay_surface *s,
+			const rec_buffer &g, size_t size) {
+		for (int tries = 0; ; tries++) {
+			for (auto &&b : s->buffers) {
+				if (!b.busy && b.geometry.width == g.width &&
+						b.geometry.height == g.height &&
+						b.geometry.stride == g.stride &&
+						b.geometry.format == g.format &&
+						b.size == size) {
+					return &b;
+				}
+			}
+			if (s->buffers.size() < MAX_BUFFERS || tries == 4) {
+				break;
+			}
+			// the compositor releases a buffer when the next one is
+			// attached, the event may not be read yet
+			for (auto it = s->buffers.begin(); it != s->buffers.end(); ) {
+				if (!it->busy) {
+					it = s->buffers.erase(it);
+				} else {
+					++it;
+				}
+			}
+			if (s->buffers.size() < MAX_BUFFERS) {
+				break;
+			}
+			c->display.roundtrip();
+		}
+
+		s->buffers.emplace_back();
+		replay_buffer &b = s->buffers.back();
+		b.geometry = g;
+		b.busy = false;
+		b.size = size;
+		b.mem = NULL;
+		int fd = void_create_shm_file("void-replay", b.size);
+		void *p = mmap(NULL, b.size, PROT_READ | PROT_WRITE,
+				MAP_SHARED, fd, 0);
+		if (p == MAP_FAILED) {
+			close(fd);
+			throw std::runtime_error("mmap");
+		}
+		b.mem = (uint8_t *)p;
+		b.pool = c->shm.create_pool(fd, b.size);
+		close(fd);
+		b.buffer = b.pool.create_buffer(0, g.width, g.height, g.stride,
+				(shm_format)g.format);
+		replay_buffer *bp = &b;
+		b.buffer.on_release() = [bp]() {
+			bp->busy = false;
+		};
+		return &b;
+	}
+
+	void add_chunk(const std::vector<uint8_t> &payload) {
+		rec_chunk c;
+		memcpy(&c, payload.data(), sizeof c);
+		const uint8_t *data = payload.data() + sizeof c;
+		uLongf size = payload.size() - sizeof c;
+		if (c.id >= chunks.size()) {
+			chunks.resize(c.id + 1);
+		}
+		std::vector<uint8_t> &out = chunks[c.id];
+		out.resize(c.raw_size);
+		if (size == c.raw_size) {
+			memcpy(out.data(), data, size);
+			return;
+		}
+		uLongf raw = c.raw_size;
+		if (uncompress(out.data(), &raw, data, size) != Z_OK ||
+				raw != c.raw_size) {
+			throw std::runtime_error("corrupt chunk");
+		}
+	}
+
+	void attach(const rec_header &h, const std::vector<uint8_t> &payload) {
+		rec_buffer g;
+		memcpy(&g, payload.data(), sizeof g);
+		size_t n = (payload.size() - sizeof g) / sizeof(uint32_t);
+		const uint8_t *ids = payload.data() + sizeof g;
+
+		// the recorder sized the content by the planes of its format,
+		// the chunks add up to the buffer to create
+		std::vector<uint32_t> chunk_ids(n);
+		size_t size = 0;
+		for (size_t i = 0; i < n; i++) {
+			memcpy(&chunk_ids[i], ids + i * sizeof(uint32_t),
+					sizeof(uint32_t));
+			if (chunk_ids[i] >= chunks.size()) {
+				throw std::runtime_error("missing chunk");
+			}
+			size += chunks[chunk_ids[i]].size();
+		}
+		size = std::max(size, (size_t)g.stride * g.height);
+
+		replay_client *c = get_client(h.client);
+		replay_surface *s = get_surface(h.client, h.surface);
+		replay_buffer *b = get_buffer(c, s, g, size);
+		size_t off = 0;
+		for (uint32_t id : chunk_ids) {
+			size_t len = std::min(chunks[id].size(), b->size - off);
+			memcpy(b->mem + off, chunks[id].data(), len);
+			off += len;
+		}
+		content_bytes += off;
+		b->busy = true;
+		s->surface.attach(b->buffer, g.x, g.y);
+	}
+
+	void frame(const rec_header &h) {
+		replay_surface *s = get_surface(h.client, h.surface);
+		s->frames.remove_if([](const replay_frame &f) {
+			return f.done;
+		});
+		s->frames.push_back(replay_frame());
+		replay_frame *f = &s->frames.back();
+		f->done = false;
+		f->callback = s->surface.frame();
+		f->callback.on_done() = [this, f](uint32_t) {
+			frames_done++;
+			f->done = true;
+		};
+	}
+
+public:
+	replayer() : records(0), commits(0), content_bytes(0), frames_done(0) {
+	}
+
+	void handle(const rec_header &h, const std::vector<uint8_t> &payload,
+			bool fast) {
+		records++;
+		switch (h.type) {
+		case REC_CLIENT_GONE:
+			clients.erase(h.client);
+			break;
+		case REC_SURFACE:
+			get_surface(h.client, h.surface);
+			break;
+		case REC_SURFACE_GONE:
+			get_client(h.client)->surfaces.erase(h.surface);
+			break;
+		case REC_TITLE:
+			get_surface(h.client, h.surface)->shell_surface.set_title(
+					std::string(payload.begin(), payload.end()));
+			break;
+		case REC_APP_ID:
+			get_surface(h.client, h.surface)->shell_surface.set_class(
+					std::string(payload.begin(), payload.end()));
+			break;
+		case REC_CHUNK:
+			add_chunk(payload);
+			break;
+		case REC_BUFFER:
+			attach(h, payload);
+			break;
+		case REC_DAMAGE: {
+			int32_t box[4];
+			memcpy(box, payload.data(), sizeof box);
+			get_surface(h.client, h.surface)->surface.damage(
+					box[0], box[1], box[2], box[3]);
+			break;
+		}
+		case REC_FRAME:
+			frame(h);
+			break;
+		case REC_COMMIT: {
+			get_surface(h.client, h.surface)->surface.commit();
+			commits++;
+			replay_client *c = get_client(h.client);
+			// keep reading events, or the compositor's queue to us fills
+			if (fast && ++c->commits % 16 == 0) {
+				c->pump();
+			}
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	void pump() {
+		for (auto &&c : clients) {
+			c.second->pump();
+		}
+	}
+
+	void finish() {
+		for (auto &&c : clients) {
+			c.second->display.roundtrip();
+		}
+	}
+
+	uint64_t get_records() { return records; }
+	uint64_t get_commits() { return commits; }
+	uint64_t get_content_bytes() { return content_bytes; }
+	uint64_t get_frames_done() { return frames_done; }
+	size_t get_clients() { return clients.size(); }
+};
+
+int main(int argc, char *argv[]) {
+	bool fast = false;
+	double speed = 1;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "fs:")) != -1) {
+		switch (opt) {
+		case 'f': fast = true; break;
+		case 's': speed = atof(optarg); break;
+		default:
+			optind = argc + 1;
+		}
+	}
+	if (argc - optind != 1 || speed <= 0) {
+		fprintf(stderr, "usage: %s [-f] [-s speed] <trace>\n", argv[0]);
+		return 1;
+	}
+
+	FILE *f = fopen(argv[optind], "rb");
+	if (!f) {
+		perror(argv[optind]);
+		return 1;
+	}
+	char magic[8];
+	if (fread(magic, 1, 8, f) != 8 ||
+			memcmp(magic, VOID_RECORD_MAGIC, 8) != 0) {
+		fprintf(stderr, "%s: not a void trace\n", argv[optind]);
+		return 1;
+	}
+
+	replayer r;
+	rec_header h;
+	std::vector<uint8_t> payload;
+	uint64_t start = now(), last_time = 0;
+	try {
+		while (fread(&h, sizeof h, 1, f) == 1) {
+			payload.resize(h.size);
+			if (h.size && fread(payload.data(), 1, h.size, f) != h.size) {
+				fprintf(stderr, "truncated trace\n");
+				break;
+			}
+			if (!fast && h.time > last_time) {
+				// send what was due before waiting for the next one
+				r.pump();
+				uint64_t due = start + (uint64_t)(h.time / speed);
+				uint64_t t = now();
+				if (due > t) {
+					usleep((due - t) / 1000);
+				}
+				last_time = h.time;
+			}
+			r.handle(h, payload, fast);
+		}
+		r.finish();
+	} catch (std::exception &e) {
+		fprintf(stderr, "replay failed: %s\n", e.what());
+		return 1;
+	}
+	fclose(f);
+
+	double secs = (now() - start) / 1e9;
+	printf("replayed %llu records, %llu commits, %.1f MB of content "
+			"in %.3f s: %.1f commits/s, %.1f MB/s, %llu frames done\n",
+			(unsigned long long)r.get_records(),
+			(unsigned long long)r.get_commits(),
+			r.get_content_bytes() / 1048576.0, secs,
+			r.get_commits() / secs,
+			r.get_content_bytes() / 1048576.0 / secs,
+			(unsigned long long)r.get_frames_done());
+	return 0;
+}
+
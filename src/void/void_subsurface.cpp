@@ -0,0 +1,136 @@
+/* void_subsurface.cpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <wayland-server.hpp>
+
+#include "void.hpp"
+#include "void_subsurface.hpp"
+
+using namespace wayland;
+using namespace wayland::detail;
+
+void_subsurface::void_subsurface(void_compositor *c, void_surface *s,
+		void_surface *p)
+	: compositor(c), surface(s), parent(p),
+	x(0), y(0), pending_x(0), pending_y(0), position_pending(false),
+	sync(true), alive(true)
+{
+}
+
+void void_subsurface::bind(subsurface_resource_t res) {
+	resource = res;
+
+	res.on_destroy() = [&]() {
+		alive = false;
+		if (!surface) {
+			delete this;
+			return;
+		}
+		// the surface stays, but is not drawn any more
+		compositor->unlink_subsurface(surface);
+	};
+
+	res.on_set_position() = [&](int32_t px, int32_t py) {
+		pending_x = px;
+		pending_y = py;
+		position_pending = true;
+	};
+
+	res.on_place_above() = [&](surface_resource_t sibling) {
+		place(sibling, true);
+	};
+
+	res.on_place_below() = [&](surface_resource_t sibling) {
+		place(sibling, false);
+	};
+
+	res.on_set_sync() = [&]() {
+		sync = true;
+	};
+
+	res.on_set_desync() = [&]() {
+		sync = false;
+		if (surface && !is_synchronized()) {
+			// what waited for the parent shows now
+			surface->flush_cached();
+		}
+	};
+}
+
+/* applied right away rather than on the parent's commit */
+void void_subsurface::place(surface_resource_t sibling_res, bool above) {
+	auto sibling = (void_surface *)sibling_res.get_user_data();
+	if (!surface || !parent) {
+		return;
+	}
+	if (!sibling || sibling == surface ||
+			!compositor->restack_subsurface(surface, sibling, above)) {
+		resource.post_bad_surface("not a sibling or the parent");
+	}
+}
+
+bool void_subsurface::is_synchronized() {
+	if (sync) {
+		return true;
+	}
+	void_subsurface *p = parent ? parent->get_subsurface() : NULL;
+	return p && p->is_synchronized();
+}
+
+void void_subsurface::parent_committed() {
+	if (position_pending) {
+		x = pending_x;
+		y = pending_y;
+		position_pending = false;
+	}
+	if (is_synchronized()) {
+		surface->apply_cached();
+	}
+}
+
+void void_subsurface::surface_gone() {
+	surface = NULL;
+	parent = NULL;
+	if (!alive) {
+		delete this;
+	}
+}
+
+void void_subcompositor::bind(resource_t res, void *data) {
+	log_debug(LOG_PROTOCOL, "client bind void_subcompositor");
+
+	auto r = new subcompositor_resource_t(res);
+
+	r->on_get_subsurface() = [this, r](subsurface_resource_t sub_res,
+			surface_resource_t surf_res, surface_resource_t parent_res) {
+		auto s = (void_surface *)surf_res.get_user_data();
+		auto p = (void_surface *)parent_res.get_user_data();
+		if (!s || !p || s == p || !compositor->add_subsurface(s, p)) {
+			r->post_bad_surface("surface cannot be a sub-surface of it");
+			return;
+		}
+		auto sub = s->get_subsurface();
+		sub->bind(sub_res);
+	};
+}
@@ -0,0 +1,116 @@
+/* void_subsurface.hpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef __VOID_SUBSURFACE_HPP_
+#define __VOID_SUBSURFACE_HPP_
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include <wayland-server.hpp>
+
+class void_compositor;
+class void_surface;
+
+/**
+ * The wl_subsurface role of a surface.
+ *
+ * The surface is drawn with its parent, at an offset from it and in the
+ * order of the parent's stack. A synchronized sub-surface, or one with
+ * a synchronized ancestor, keeps what it commits until the parent
+ * commits; a desynchronized one shows its commits right away.
+ *
+ * The role outlives whichever of the surface and the wl_subsurface goes
+ * first: without a parent the surface is not drawn, and the object is
+ * freed once both are gone. Dispatch thread, but for the offset.
+ */
+class void_subsurface {
+private:
+	wayland::subsurface_resource_t resource;
+	void_compositor *compositor;
+	void_surface *surface;
+	void_surface *parent;
+
+	/* offset from the parent, read by the render thread */
+	std::atomic<int32_t> x, y;
+	/* set_position takes effect on the parent's commit */
+	int32_t pending_x, pending_y;
+	bool position_pending;
+	bool sync;
+	/* the wl_subsurface still exists */
+	bool alive;
+
+	void place(wayland::surface_resource_t sibling_res, bool above);
+
+public:
+	void_subsurface(void_compositor *c, void_surface *s, void_surface *p);
+
+	void bind(wayland::subsurface_resource_t res);
+
+	void_surface *get_parent() {
+		return parent;
+	}
+	int32_t get_x() {
+		return x;
+	}
+	int32_t get_y() {
+		return y;
+	}
+	/* render thread, by the attach offset */
+	void translate(int32_t dx, int32_t dy) {
+		x += dx;
+		y += dy;
+	}
+
+	/* this or an ancestor is in synchronized mode */
+	bool is_synchronized();
+	void parent_committed();
+
+	/* with scene_mutex held, the surfaces are being destroyed */
+	void parent_gone() {
+		parent = NULL;
+	}
+	void surface_gone();
+};
+
+class void_subcompositor : public wayland::global_t {
+private:
+	wayland::display_server_t display;
+	void_compositor *compositor;
+
+public:
+	void_subcompositor(wayland::display_server_t disp,
+			void_compositor *c)
+		: global_t(disp, wayland::detail::subcompositor_interface, 1, this,
+				NULL),
+		display(disp),
+		compositor(c)
+	{
+	}
+
+	virtual void bind(wayland::resource_t res, void *data);
+};
+
+#endif
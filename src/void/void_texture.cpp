@@ -0,0 +1,188 @@
+/* void_texture.cpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+
+#include "void.hpp"
+#include "void_texture.hpp"
+#include "gl_state.hpp"
+
+void_texture_budget::void_texture_budget()
+	: budget(0),
+	resident_bytes(0), resident_count(0),
+	evictions(0), reuploads(0)
+{
+}
+
+void_texture_budget::link_t void_texture_budget::add(void_surface *s,
+		int64_t bytes) {
+	resident_bytes += bytes;
+	resident_count++;
+	lru.push_front(s);
+	return lru.begin();
+}
+
+void void_texture_budget::remove(link_t link, int64_t bytes) {
+	resident_bytes -= bytes;
+	resident_count--;
+	lru.erase(link);
+}
+
+void void_texture_budget::touch(link_t link) {
+	lru.splice(lru.begin(), lru, link);
+}
+
+void void_texture_budget::evict(uint64_t frame_count) {
+	if (!budget) {
+		return;
+	}
+	while (resident_bytes > budget && !lru.empty()) {
+		void_surface *s = lru.back();
+		if (s->get_last_drawn() == frame_count) {
+			// everything left is on screen
+			break;
+		}
+		s->evict_texture();
+		evictions++;
+	}
+}
+
+std::string void_texture_budget::describe() {
+	char out[512];
+	snprintf(out, sizeof out,
+			"budget %lld\n"
+			"resident_bytes %lld\n"
+			"resident_textures %d\n"
+			"evictions %llu\n"
+			"reuploads %llu\n",
+			(long long)budget,
+			(long long)resident_bytes,
+			(int)resident_count,
+			(unsigned long long)evictions,
+			(unsigned long long)reuploads);
+	return out;
+}
+
+void_texture_pool::void_texture_pool()
+	: granularity(64), free_limit(64 << 20),
+	gl(NULL),
+	free_bytes(0),
+	allocations(0), reuses(0), frees(0)
+{
+}
+
+int32_t void_texture_pool::size_class(int32_t size) {
+	if (size <= 0) {
+		size = 1;
+	}
+	if (granularity > 0) {
+		return (size + granularity - 1) / granularity * granularity;
+	}
+	int32_t c = 1;
+	while (c < size) {
+		c <<= 1;
+	}
+	return c;
+}
+
+void_texture void_texture_pool::acquire(int32_t width, int32_t height,
+		GLenum format, GLenum type) {
+	void_texture tex;
+	tex.width = size_class(width);
+	tex.height = size_class(height);
+	tex.format = format;
+	tex.type = type;
+
+	key_t key(tex.width, tex.height, format, type);
+	auto it = bucket_dict.find(key);
+	if (it != bucket_dict.end() && !it->second.empty()) {
+		tex.id = it->second.front();
+		it->second.pop_front();
+		free_bytes -= tex.get_bytes();
+		for (auto f = free_order.begin(); f != free_order.end(); ++f) {
+			if (f->second == tex.id) {
+				free_order.erase(f);
+				break;
+			}
+		}
+		reuses++;
+		return tex;
+	}
+
+	glGenTextures(1, &tex.id);
+	gl->bind_texture(tex.id);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	// required for non power of two sizes on GLES2
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, format, tex.width, tex.height, 0,
+			format, type, NULL);
+	allocations++;
+	return tex;
+}
+
+void void_texture_pool::release(void_texture &tex) {
+	if (!tex.id) {
+		return;
+	}
+	key_t key(tex.width, tex.height, tex.format, tex.type);
+	bucket_dict[key].push_front(tex.id);
+	free_order.push_back(std::make_pair(key, tex.id));
+	free_bytes += tex.get_bytes();
+	tex = void_texture();
+}
+
+void void_texture_pool::trim() {
+	while (free_bytes > free_limit && !free_order.empty()) {
+		key_t key = free_order.front().first;
+		GLuint id = free_order.front().second;
+		free_order.pop_front();
+
+		bucket_dict[key].remove(id);
+		glDeleteTextures(1, &id);
+		// a deleted name bound anywhere reverts to 0
+		gl->invalidate();
+		free_bytes -= (int64_t)std::get<0>(key) * std::get<1>(key) *
+			void_texture::texel_size(std::get<2>(key),
+					std::get<3>(key));
+		frees++;
+	}
+}
+
+std::string void_texture_pool::describe() {
+	char out[512];
+	snprintf(out, sizeof out,
+			"pool_granularity %d\n"
+			"pool_free_bytes %lld\n"
+			"pool_allocations %llu\n"
+			"pool_reuses %llu\n"
+			"pool_frees %llu\n",
+			granularity,
+			(long long)free_bytes,
+			(unsigned long long)allocations,
+			(unsigned long long)reuses,
+			(unsigned long long)frees);
+	return out;
+}
+
@@ -0,0 +1,182 @@
+/* void_texture.hpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __VOID_TEXTURE_HPP_
+#define __VOID_TEXTURE_HPP_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <deque>
+#include <string>
+#include <tuple>
+
+#include <GLES2/gl2.h>
+
+class void_surface;
+class gl_state;
+
+/**
+ * A texture whose storage is rounded up to a size class; the content
+ * lives in the top-left corner and is sampled with a texcoord scale.
+ */
+struct void_texture {
+	GLuint id;
+	int32_t width, height;	/* storage size */
+	GLenum format, type;
+	/* minification filter set on it, 0 when not known */
+	GLenum filter;
+	/* the mipmap levels match the content */
+	bool mipmapped;
+
+	void_texture() : id(0), width(0), height(0), format(GL_RGBA),
+		type(GL_UNSIGNED_BYTE), filter(0), mipmapped(false) {}
+
+	static int texel_size(GLenum format, GLenum type) {
+		if (type != GL_UNSIGNED_BYTE) {
+			// the packed 16 bit types
+			return 2;
+		}
+		switch (format) {
+		case GL_LUMINANCE:
+		case GL_ALPHA:
+			return 1;
+		case GL_LUMINANCE_ALPHA:
+			return 2;
+		case GL_RGB:
+			return 3;
+		default:
+			return 4;
+		}
+	}
+
+	int64_t get_bytes() const {
+		return (int64_t)width * height * texel_size(format, type);
+	}
+};
+
+/**
+ * Compositor-wide pool of textures bucketed by size class and format.
+ *
+ * Sizes are rounded up to a multiple of the granularity (64 px by
+ * default) or to a power of two, so a window being resized keeps
+ * hitting the same few storages and only does sub-image uploads.
+ * Released textures wait in their bucket until reused or trimmed.
+ * Render thread only, except for the counters.
+ */
+class void_texture_pool {
+private:
+	int granularity;	/* 0 means power of two */
+	int64_t free_limit;
+	gl_state *gl;
+
+	/* width, height, format, type */
+	typedef std::tuple<int32_t, int32_t, GLenum, GLenum> key_t;
+	std::map<key_t, std::list<GLuint>> bucket_dict;
+	/* released order, for trimming the oldest first */
+	std::deque<std::pair<key_t, GLuint>> free_order;
+	int64_t free_bytes;
+
+	std::atomic<uint64_t> allocations;
+	std::atomic<uint64_t> reuses;
+	std::atomic<uint64_t> frees;
+
+public:
+	void_texture_pool();
+
+	void set_granularity(int g) {
+		granularity = g;
+	}
+	void set_free_limit(int64_t bytes) {
+		free_limit = bytes;
+	}
+	void set_gl_state(gl_state *state) {
+		gl = state;
+	}
+
+	int32_t size_class(int32_t size);
+	bool fits(const void_texture &tex, int32_t width, int32_t height,
+			GLenum format = GL_RGBA, GLenum type = GL_UNSIGNED_BYTE) {
+		return tex.id && tex.format == format && tex.type == type &&
+			tex.width == size_class(width) &&
+			tex.height == size_class(height);
+	}
+
+	void_texture acquire(int32_t width, int32_t height,
+			GLenum format = GL_RGBA, GLenum type = GL_UNSIGNED_BYTE);
+	void release(void_texture &tex);
+	void trim();
+
+	std::string describe();
+};
+
+/**
+ * Global budget for surface textures.
+ *
+ * Surfaces are kept in least-recently-drawn order. When the resident
+ * bytes go over the budget, textures of surfaces that were not drawn
+ * in the current frame are dropped, oldest first. An evicted surface
+ * uploads again from its attached buffer when it gets drawn next.
+ * Render thread only, except for the counters.
+ */
+class void_texture_budget {
+public:
+	typedef std::list<void_surface *>::iterator link_t;
+
+private:
+	int64_t budget;
+	std::atomic<int64_t> resident_bytes;
+	std::atomic<int32_t> resident_count;
+	std::atomic<uint64_t> evictions;
+	std::atomic<uint64_t> reuploads;
+
+	/* front is the most recently drawn */
+	std::list<void_surface *> lru;
+
+public:
+	void_texture_budget();
+
+	void set_budget(int64_t bytes) {
+		budget = bytes;
+	}
+
+	link_t add(void_surface *s, int64_t bytes);
+	void remove(link_t link, int64_t bytes);
+	void resize(int64_t old_bytes, int64_t new_bytes) {
+		resident_bytes += new_bytes - old_bytes;
+	}
+
+	void touch(link_t link);
+	void evict(uint64_t frame_count);
+
+	void count_reupload() {
+		reuploads++;
+	}
+
+	std::string describe();
+};
+
+#endif
+
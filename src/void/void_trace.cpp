@@ -0,0 +1,251 @@
+/* void_trace.cpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <semaphore.h>
+#include <sys/syscall.h>
+
+#include <atomic>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "void_trace.hpp"
+#include "void_log.hpp"
+
+bool void_trace_enabled = false;
+
+namespace {
+
+const uint64_t RING_SIZE = 1 << 16;	/* power of two */
+
+struct trace_event {
+	const char *name;
+	uint64_t start;
+	uint64_t end;
+};
+
+/* written by the owning thread only, read by dump() */
+struct trace_ring {
+	trace_event *events;
+	std::atomic<uint64_t> head;
+	int32_t tid;
+	std::string thread_name;
+
+	trace_ring() : events(new trace_event[RING_SIZE]), head(0) {
+		tid = syscall(SYS_gettid);
+	}
+};
+
+std::mutex ring_mutex;
+std::vector<trace_ring *> ring_list;
+thread_local trace_ring *local_ring = NULL;
+
+std::string dump_file;
+std::mutex dump_mutex;
+std::thread *dumper = NULL;
+sem_t dump_sem;
+std::atomic<bool> stopping(false);
+
+trace_ring *get_ring() {
+	if (!local_ring) {
+		local_ring = new trace_ring;
+		std::lock_guard<std::mutex> lock(ring_mutex);
+		ring_list.push_back(local_ring);
+	}
+	return local_ring;
+}
+
+void on_signal(int) {
+	// the only thing a handler may do here, the dumper does the rest
+	sem_post(&dump_sem);
+}
+
+void run_dumper() {
+	while (true) {
+		while (sem_wait(&dump_sem) < 0 && errno == EINTR) {
+		}
+		if (stopping) {
+			break;
+		}
+		std::string file;
+		{
+			std::lock_guard<std::mutex> lock(dump_mutex);
+			file = dump_file;
+		}
+		void_trace::dump(file);
+	}
+}
+
+}
+
+uint64_t void_trace::now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void void_trace::record(const char *name, uint64_t start, uint64_t end) {
+	trace_ring *r = get_ring();
+	uint64_t h = r->head.load(std::memory_order_relaxed);
+	trace_event &e = r->events[h & (RING_SIZE - 1)];
+	e.name = name;
+	e.start = start;
+	e.end = end;
+	r->head.store(h + 1, std::memory_order_release);
+}
+
+void void_trace::set_thread_name(const char *name) {
+	trace_ring *r = get_ring();
+	std::lock_guard<std::mutex> lock(ring_mutex);
+	r->thread_name = name;
+}
+
+int void_trace::init(const std::string &filename) {
+	{
+		std::lock_guard<std::mutex> lock(dump_mutex);
+		dump_file = filename;
+	}
+	if (dumper) {
+		return 0;
+	}
+	sem_init(&dump_sem, 0, 0);
+	stopping = false;
+	dumper = new std::thread(run_dumper);
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof sa);
+	sa.sa_handler = on_signal;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(SIGUSR2, &sa, NULL) < 0) {
+		log_warn(LOG_CORE, "trace: sigaction: %s", strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+void void_trace::shutdown() {
+	if (!dumper) {
+		return;
+	}
+	signal(SIGUSR2, SIG_DFL);
+	stopping = true;
+	sem_post(&dump_sem);
+	dumper->join();
+	delete dumper;
+	dumper = NULL;
+	sem_destroy(&dump_sem);
+}
+
+void void_trace::enable(bool on) {
+	__atomic_store_n(&void_trace_enabled, on, __ATOMIC_RELAXED);
+}
+
+int void_trace::dump(const std::string &filename) {
+	std::string tmp = filename + ".tmp";
+	FILE *f = fopen(tmp.c_str(), "w");
+	if (!f) {
+		log_error(LOG_CORE, "trace %s: %s", tmp.c_str(), strerror(errno));
+		return -1;
+	}
+
+	int pid = getpid();
+	std::vector<trace_event> events;
+	bool first = true;
+	size_t count = 0;
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+	std::lock_guard<std::mutex> lock(ring_mutex);
+	for (auto r : ring_list) {
+		if (!r->thread_name.empty()) {
+			fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\","
+					"\"pid\":%d,\"tid\":%d,"
+					"\"args\":{\"name\":\"%s\"}}",
+					first ? "" : ",", pid, r->tid,
+					r->thread_name.c_str());
+			first = false;
+		}
+
+		uint64_t head = r->head.load(std::memory_order_acquire);
+		uint64_t begin = head > RING_SIZE ? head - RING_SIZE : 0;
+		events.clear();
+		for (uint64_t i = begin; i < head; i++) {
+			events.push_back(r->events[i & (RING_SIZE - 1)]);
+		}
+		// the thread keeps going, drop what it overwrote meanwhile
+		uint64_t after = r->head.load(std::memory_order_acquire);
+		uint64_t valid = after > RING_SIZE ? after - RING_SIZE : 0;
+		size_t skip = valid > begin ? valid - begin : 0;
+
+		for (size_t i = skip; i < events.size(); i++) {
+			const trace_event &e = events[i];
+			fprintf(f, "%s\n{\"name\":\"%s\",\"cat\":\"void\","
+					"\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+					"\"ts\":%.3f,\"dur\":%.3f}",
+					first ? "" : ",", e.name, pid, r->tid,
+					e.start / 1000.0, (e.end - e.start) / 1000.0);
+			first = false;
+			count++;
+		}
+	}
+	fprintf(f, "\n]}\n");
+
+	if (fclose(f) != 0 || rename(tmp.c_str(), filename.c_str()) < 0) {
+		log_error(LOG_CORE, "trace %s: %s",
+				filename.c_str(), strerror(errno));
+		return -1;
+	}
+	log_info(LOG_CORE, "trace: %zu spans written to %s",
+			count, filename.c_str());
+	return 0;
+}
+
+std::string void_trace::command(const std::string &args) {
+	std::istringstream in(args);
+	std::string what, file;
+	in >> what >> file;
+	if (what == "on" || what == "off") {
+		enable(what == "on");
+	} else if (what == "dump") {
+		if (file.empty()) {
+			std::lock_guard<std::mutex> lock(dump_mutex);
+			file = dump_file;
+		}
+		if (dump(file) < 0) {
+			return "failed to write " + file + "\n";
+		}
+		return "written to " + file + "\n";
+	} else if (!what.empty()) {
+		return "usage: trace [on | off | dump [file]]\n";
+	}
+	return std::string("tracing ") +
+		(void_trace_enabled ? "on" : "off") + "\n";
+}
+
@@ -0,0 +1,87 @@
+/* void_trace.hpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __VOID_TRACE_HPP_
+#define __VOID_TRACE_HPP_
+
+#include <stdint.h>
+
+#include <string>
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+/* times the rest of the enclosing scope, name must be a string literal */
+#define TRACE_SCOPE(name) \
+	void_trace_scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+
+extern bool void_trace_enabled;
+
+namespace void_trace {
+	uint64_t now();
+	void record(const char *name, uint64_t start, uint64_t end);
+
+	/* shows up as the track name in the viewer */
+	void set_thread_name(const char *name);
+
+	/* installs the SIGUSR2 handler that dumps to filename */
+	int init(const std::string &filename);
+	void shutdown();
+
+	void enable(bool on);
+	int dump(const std::string &filename);
+
+	/* the "trace" control command */
+	std::string command(const std::string &args);
+}
+
+/**
+ * A span of the timeline, from construction to destruction.
+ *
+ * Spans go into a ring of the current thread without locking; the ring
+ * keeps the most recent ones and is written out as Chrome trace-event
+ * JSON on demand, which chrome://tracing and Perfetto load. With tracing
+ * off a span costs one load and a branch.
+ */
+class void_trace_scope {
+private:
+	const char *name;
+	uint64_t start;
+
+public:
+	explicit void_trace_scope(const char *n)
+		: name(n),
+		start(__atomic_load_n(&void_trace_enabled, __ATOMIC_RELAXED) ?
+				void_trace::now() : 0)
+	{
+	}
+
+	~void_trace_scope() {
+		if (start) {
+			void_trace::record(name, start, void_trace::now());
+		}
+	}
+};
+
+#endif
+
@@ -0,0 +1,182 @@
+/* void_upload.cpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+
+#include <future>
+
+#include <wayland-util.hpp>
+#include <wayland-server.hpp>
+
+#include "wrapper.hpp"
+#include "void_upload.hpp"
+#include "void_log.hpp"
+#include "void_trace.hpp"
+#include "void_metrics.hpp"
+
+void_uploader::void_uploader()
+	: wrapper(NULL), egldisplay(EGL_NO_DISPLAY),
+	running(false), available(false), td(NULL),
+	create_sync(NULL), destroy_sync(NULL), client_wait_sync(NULL),
+	async_uploads(0), async_bytes(0)
+{
+}
+
+void_uploader::~void_uploader() {
+	stop();
+}
+
+int void_uploader::start(display_wrapper_t *w) {
+	wrapper = w;
+	egldisplay = w->get_egl_display();
+
+	if (w->has_egl_extension("EGL_KHR_fence_sync")) {
+		create_sync = (PFNEGLCREATESYNCKHRPROC)
+			eglGetProcAddress("eglCreateSyncKHR");
+		destroy_sync = (PFNEGLDESTROYSYNCKHRPROC)
+			eglGetProcAddress("eglDestroySyncKHR");
+		client_wait_sync = (PFNEGLCLIENTWAITSYNCKHRPROC)
+			eglGetProcAddress("eglClientWaitSyncKHR");
+	}
+
+	std::promise<bool> started;
+	std::future<bool> result = started.get_future();
+	running = true;
+	td = new std::thread([this, &started]() {
+		void_trace::set_thread_name("upload");
+		bool ok = wrapper->bind_upload_context();
+		started.set_value(ok);
+		if (ok) {
+			run();
+		}
+	});
+	available = result.get();
+	if (!available) {
+		log_warn(LOG_RENDER, "no shared EGL context, uploading synchronously.");
+		td->join();
+		delete td;
+		td = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+void void_uploader::stop() {
+	if (!td) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(job_mutex);
+		running = false;
+	}
+	job_cond.notify_all();
+	td->join();
+	delete td;
+	td = NULL;
+	available = false;
+}
+
+void void_uploader::submit(void_upload_job *job) {
+	{
+		std::lock_guard<std::mutex> lock(job_mutex);
+		job_queue.push_back(job);
+	}
+	job_cond.notify_all();
+}
+
+void void_uploader::run() {
+	std::unique_lock<std::mutex> lock(job_mutex);
+	while (true) {
+		job_cond.wait(lock, [this]() {
+			return !running || !job_queue.empty();
+		});
+		if (job_queue.empty()) {
+			// only leave once everything queued has been done
+			break;
+		}
+		void_upload_job *job = job_queue.front();
+		job_queue.pop_front();
+		lock.unlock();
+
+		TRACE_SCOPE("upload async");
+		uint64_t start = void_metrics::now();
+		glBindTexture(GL_TEXTURE_2D, job->texture);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
+				job->width, job->height,
+				GL_RGBA, GL_UNSIGNED_BYTE,
+				job->pixels.data());
+		if (create_sync) {
+			job->fence = create_sync(egldisplay, EGL_SYNC_FENCE_KHR, NULL);
+			glFlush();
+		} else {
+			glFinish();
+		}
+		job->duration = void_metrics::now() - start;
+		async_uploads++;
+		async_bytes += (uint64_t)job->width * job->height * 4;
+
+		lock.lock();
+		job->state = void_upload_job::DONE;
+		job_cond.notify_all();
+	}
+	wrapper->release_upload_context();
+}
+
+bool void_uploader::ready(void_upload_job *job) {
+	if (job->state != void_upload_job::DONE) {
+		return false;
+	}
+	if (job->fence == EGL_NO_SYNC_KHR) {
+		return true;
+	}
+	return client_wait_sync(egldisplay, job->fence, 0, 0) ==
+		EGL_CONDITION_SATISFIED_KHR;
+}
+
+void void_uploader::finish(void_upload_job *job) {
+	{
+		std::unique_lock<std::mutex> lock(job_mutex);
+		job_cond.wait(lock, [job]() {
+			return job->state == void_upload_job::DONE;
+		});
+	}
+	if (job->fence != EGL_NO_SYNC_KHR) {
+		client_wait_sync(egldisplay, job->fence,
+				EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, EGL_FOREVER_KHR);
+		destroy_sync(egldisplay, job->fence);
+	}
+	delete job;
+}
+
+std::string void_uploader::describe() {
+	char out[256];
+	snprintf(out, sizeof out,
+			"async_available %d\n"
+			"async_uploads %llu\n"
+			"async_upload_bytes %llu\n",
+			available ? 1 : 0,
+			(unsigned long long)async_uploads,
+			(unsigned long long)async_bytes);
+	return out;
+}
+
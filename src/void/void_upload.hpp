@@ -0,0 +1,117 @@
+/* void_upload.hpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __VOID_UPLOAD_HPP_
+#define __VOID_UPLOAD_HPP_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <string>
+#include <vector>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+
+class display_wrapper_t;
+
+struct void_upload_job {
+	enum job_state {
+		QUEUED,
+		DONE,
+	};
+
+	GLuint texture;
+	int32_t width, height;
+	/* RGBA rows, copied out of the client's buffer when submitted so
+	 * the client may reuse or destroy it meanwhile */
+	std::vector<uint8_t> pixels;
+
+	std::atomic<int> state;
+	EGLSyncKHR fence;
+	/* ns the upload thread spent on it */
+	uint64_t duration;
+
+	void_upload_job()
+		: texture(0), width(0), height(0),
+		state(QUEUED), fence(EGL_NO_SYNC_KHR), duration(0)
+	{
+	}
+};
+
+/**
+ * Texture uploads on a dedicated thread.
+ *
+ * The thread owns an EGL context shared with the render context and
+ * copies buffers into textures the renderer is not sampling from. Each
+ * finished upload is followed by an EGL fence; the renderer keeps
+ * showing the previous texture until ready() sees the fence signaled.
+ */
+class void_uploader {
+private:
+	display_wrapper_t *wrapper;
+	EGLDisplay egldisplay;
+	bool running;
+	bool available;
+	std::thread *td;
+
+	std::mutex job_mutex;
+	std::condition_variable job_cond;
+	std::deque<void_upload_job *> job_queue;
+
+	PFNEGLCREATESYNCKHRPROC create_sync;
+	PFNEGLDESTROYSYNCKHRPROC destroy_sync;
+	PFNEGLCLIENTWAITSYNCKHRPROC client_wait_sync;
+
+	std::atomic<uint64_t> async_uploads;
+	std::atomic<uint64_t> async_bytes;
+
+	void run();
+
+public:
+	void_uploader();
+	~void_uploader();
+
+	int start(display_wrapper_t *w);
+	void stop();
+
+	bool is_available() {
+		return available;
+	}
+
+	void submit(void_upload_job *job);
+	/* render thread: true once the texture can be sampled */
+	bool ready(void_upload_job *job);
+	/* blocks until the job is done, then frees it */
+	void finish(void_upload_job *job);
+
+	std::string describe();
+};
+
+#endif
+
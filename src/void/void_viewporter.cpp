@@ -0,0 +1,111 @@
+/* void_viewporter.cpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <math.h>
+
+#include "void.hpp"
+#include "void_viewporter.hpp"
+
+using namespace wayland;
+using namespace wayland::detail;
+
+void void_viewport::bind(wp_viewport_resource_t res) {
+	resource = res;
+
+	res.on_destroy() = [&]() {
+		if (surface) {
+			// back to the buffer's own size from the next commit
+			surface->set_source(-1, -1, -1, -1);
+			surface->set_destination(-1, -1);
+			surface->set_viewport(NULL);
+		}
+		delete this;
+	};
+
+	res.on_set_source() = [&](double x, double y, double w, double h) {
+		if (!surface) {
+			resource.post_no_surface("the surface is gone");
+			return;
+		}
+		bool unset = x == -1 && y == -1 && w == -1 && h == -1;
+		if (!unset && (x < 0 || y < 0 || w <= 0 || h <= 0)) {
+			resource.post_bad_value("source rectangle out of range");
+			return;
+		}
+		surface->set_source(x, y, w, h);
+	};
+
+	res.on_set_destination() = [&](int32_t w, int32_t h) {
+		if (!surface) {
+			resource.post_no_surface("the surface is gone");
+			return;
+		}
+		bool unset = w == -1 && h == -1;
+		if (!unset && (w <= 0 || h <= 0)) {
+			resource.post_bad_value("destination size out of range");
+			return;
+		}
+		surface->set_destination(w, h);
+	};
+}
+
+/* the source rectangle is in surface coordinates, after the buffer scale */
+bool void_viewport::check(shm_buffer_t *buf, int32_t buffer_scale,
+		double src_x, double src_y, double src_w, double src_h,
+		int32_t dst_w) {
+	if (src_w < 0) {
+		return true;
+	}
+	if (dst_w <= 0 && (src_w != floor(src_w) || src_h != floor(src_h))) {
+		resource.post_bad_size("source size is not an integer");
+		return false;
+	}
+	if (buf && (src_x + src_w > (double)buf->get_width() / buffer_scale ||
+				src_y + src_h > (double)buf->get_height() / buffer_scale)) {
+		resource.post_out_of_buffer("source rectangle outside the buffer");
+		return false;
+	}
+	return true;
+}
+
+void void_viewporter::bind(resource_t res, void *data) {
+	log_debug(LOG_PROTOCOL, "client bind void_viewporter");
+
+	auto r = new wp_viewporter_resource_t(res);
+
+	r->on_get_viewport() = [r](wp_viewport_resource_t vp_res,
+			surface_resource_t surf_res) {
+		auto s = (void_surface *)surf_res.get_user_data();
+		if (!s) {
+			return;
+		}
+		if (s->get_viewport()) {
+			r->post_viewport_exists("the surface has a viewport");
+			return;
+		}
+		auto vp = new void_viewport(s);
+		vp->bind(vp_res);
+		s->set_viewport(vp);
+	};
+}
@@ -0,0 +1,87 @@
+/* void_viewporter.hpp
+ *
+ * Copyright (c) 2016-2017 Yisu Peng
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef __VOID_VIEWPORTER_HPP_
+#define __VOID_VIEWPORTER_HPP_
+
+#include <stdint.h>
+
+#include <wayland-server.hpp>
+#include <wayland-shm.hpp>
+#include <viewporter-server-protocol.hpp>
+
+class void_compositor;
+class void_surface;
+
+/**
+ * wp_viewport of a surface: a source rectangle of the buffer, scaled
+ * to a destination size. Both are surface state and take effect on
+ * commit; the renderer applies them in the texcoords and the size of
+ * the quad, so the client never scales on the CPU.
+ *
+ * Freed with the wp_viewport; once the surface is gone the requests
+ * are errors. Dispatch thread.
+ */
+class void_viewport {
+private:
+	wayland::wp_viewport_resource_t resource;
+	void_surface *surface;
+
+public:
+	void_viewport(void_surface *s)
+		: surface(s)
+	{
+	}
+
+	void bind(wayland::wp_viewport_resource_t res);
+
+	void surface_gone() {
+		surface = NULL;
+	}
+
+	/* at commit, false once an error was posted */
+	bool check(wayland::shm_buffer_t *buf, int32_t buffer_scale,
+			double src_x, double src_y, double src_w, double src_h,
+			int32_t dst_w);
+};
+
+class void_viewporter : public wayland::global_t {
+private:
+	wayland::display_server_t display;
+	void_compositor *compositor;
+
+public:
+	void_viewporter(wayland::display_server_t disp,
+			void_compositor *c)
+		: global_t(disp, wayland::detail::wp_viewporter_interface, 1, this,
+				NULL),
+		display(disp),
+		compositor(c)
+	{
+	}
+
+	virtual void bind(wayland::resource_t res, void *data);
+};
+
+#endif
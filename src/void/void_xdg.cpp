@@ -54,13 +54,14 @@ using namespace wayland;
 using namespace wayland::detail;
 
 void void_zxdg_shell_v6::bind(resource_t res, void *data) {
-	std::cout << "client bind void_zxdg_shell_v6" << std::endl;
+	log_debug(LOG_PROTOCOL, "client bind void_zxdg_shell_v6");
 
 	auto r = new zxdg_shell_v6_resource_t(res);
 
 	r->on_get_xdg_surface() = [&](zxdg_surface_v6_resource_t res,
 			surface_resource_t wlsurf_res) {
-		auto p = new void_zxdg_surface_v6(compositor);
+		auto p = new void_zxdg_surface_v6(compositor,
+				compositor->get_client(res.get_client()));
 		p->bind(res);
 		p->bind_wlsurface(wlsurf_res);
 	};
@@ -68,6 +69,22 @@ void void_zxdg_shell_v6::bind(resource_t res, void *data) {
 
 void void_zxdg_surface_v6::bind(zxdg_surface_v6_resource_t res) {
 	resource = res;
+	res.set_user_data(this);
+	client->ref_object(void_client::OBJ_XDG_SURFACE);
+
+	res.on_destroy() = [&]() {
+		client->unref_object(void_client::OBJ_XDG_SURFACE);
+		// a resize grab would still configure it
+		if (wlsurf) {
+			compositor->get_grab().cancel(wlsurf);
+		}
+	};
+
+	res.on_ack_configure() = [&](uint32_t serial) {
+		if (wlsurf) {
+			compositor->get_grab().ack(wlsurf, serial);
+		}
+	};
 
 	res.on_get_toplevel() = [&](zxdg_toplevel_v6_resource_t top_res) {
 		auto p = new void_zxdg_toplevel_v6(compositor);
@@ -80,6 +97,13 @@ void void_zxdg_toplevel_v6::bind(zxdg_toplevel_v6_resource_t res) {
 	resource = res;
 	res.set_user_data(this);
 
+	res.on_destroy() = [&]() {
+		// the resize grab's configures go to this resource
+		if (surface && surface->get_wlsurface()) {
+			compositor->get_grab().cancel(surface->get_wlsurface());
+		}
+	};
+
 	res.on_set_parent() = [&](zxdg_toplevel_v6_resource_t parent_res) {
 		if (!parent_res) {
 			return;
@@ -91,13 +115,19 @@ void void_zxdg_toplevel_v6::bind(zxdg_toplevel_v6_resource_t res) {
 	};
 
 	res.on_set_title() = [&](std::string title) {
-		cout << "setting title: " << title << endl;
+		log_debug(LOG_SHELL, "setting title: %s", title.c_str());
 		this->title = title;
+		if (surface && surface->get_wlsurface()) {
+			surface->get_wlsurface()->set_title(title);
+		}
 	};
 
 	res.on_set_app_id() = [&](std::string appid) {
-		cout << "setting appid: " << appid << endl;
+		log_debug(LOG_SHELL, "setting appid: %s", appid.c_str());
 		this->appid = appid;
+		if (surface && surface->get_wlsurface()) {
+			surface->get_wlsurface()->set_app_id(appid);
+		}
 	};
 
 	res.on_set_maximized() = [&]() {
@@ -106,10 +136,36 @@ void void_zxdg_toplevel_v6::bind(zxdg_toplevel_v6_resource_t res) {
 		w = compositor->get_width();
 		h = compositor->get_height();
 		
-		cout << "setting maximized (" << w << ", " << h << ")" << endl;
+		log_debug(LOG_SHELL, "setting maximized (%d, %d)", w, h);
 		array_t states{zxdg_toplevel_v6_state::maximized};
 		resource.send_configure(w, h, states);
 	};
+
+	res.on_move() = [&](seat_resource_t seat, uint32_t serial) {
+		if (surface && surface->get_wlsurface()) {
+			compositor->begin_move(surface->get_wlsurface());
+		}
+	};
+
+	res.on_resize() = [&](seat_resource_t seat, uint32_t serial,
+			zxdg_toplevel_v6_resize_edge edges) {
+		if (!surface || !surface->get_wlsurface()) {
+			return;
+		}
+		compositor->begin_resize(surface->get_wlsurface(),
+				static_cast<uint32_t>(edges),
+				[this](int32_t w, int32_t h, bool resizing) -> uint32_t {
+			std::vector<zxdg_toplevel_v6_state> states;
+			states.push_back(zxdg_toplevel_v6_state::activated);
+			if (resizing) {
+				states.push_back(zxdg_toplevel_v6_state::resizing);
+			}
+			resource.send_configure(w, h, array_t(states));
+			uint32_t serial = compositor->next_serial();
+			surface->send_configure(serial);
+			return serial;
+		});
+	};
 }
 
 
@@ -46,18 +46,20 @@
 
 class void_compositor;
 class void_surface;
+class void_client;
 
 
 class void_zxdg_surface_v6 {
 private:
 	wayland::zxdg_surface_v6_resource_t resource;
 	void_compositor *compositor;
+	void_client *client;
 	void_surface *wlsurf;
 	bool surface_grabbing;
 
 public:
-	void_zxdg_surface_v6(void_compositor *c)
-		: compositor(c),
+	void_zxdg_surface_v6(void_compositor *c, void_client *cl)
+		: compositor(c), client(cl),
 		surface_grabbing(false)
 	{
 	}
@@ -68,6 +70,12 @@ public:
 		//wlsurf_res = surf;
 		wlsurf = (void_surface *)wlsurf_res.get_user_data();
 	}
+	void_surface *get_wlsurface() {
+		return wlsurf;
+	}
+	void send_configure(uint32_t serial) {
+		resource.send_configure(serial);
+	}
 };
 
 class void_zxdg_toplevel_v6 {
@@ -82,7 +90,7 @@ private:
 
 public:
 	void_zxdg_toplevel_v6(void_compositor *c)
-		: compositor(c)
+		: compositor(c), surface(NULL), maximized(false)
 	{
 	}
 
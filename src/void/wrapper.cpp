@@ -28,6 +28,9 @@
  * This is an display_wrapper_t of how to use the Wayland C++ bindings with OpenGL ES.
  */
 
+#include <poll.h>
+
+#include <algorithm>
 #include <stdexcept>
 #include <iostream>
 #include <array>
@@ -43,6 +46,10 @@
 
 #include "wrapper.hpp"
 #include "helper.hpp"
+#include "void_log.hpp"
+#include "void_metrics.hpp"
+#include "void_trace.hpp"
+#include "void_clock.hpp"
 
 using namespace wayland;
 
@@ -58,11 +65,14 @@ using namespace wayland;
 static const char vertex_shader_source[] =
 "attribute vec2 position;\n"
 "//attribute vec2 texcoord;\n"
+"uniform vec2 texoffset;\n"
+"uniform vec2 texscale;\n"
 "varying vec2 v_texcoord;\n"
 "void main()\n"
 "{\n"
 "	gl_Position = vec4(position, 0.0, 1.0);\n"
-"	v_texcoord = -position * vec2(0.5) + vec2(0.5);\n"
+"	v_texcoord = texoffset +\n"
+"		(-position * vec2(0.5) + vec2(0.5)) * texscale;\n"
 "   //v_texcoord = texcoord;\n"
 "}\n";
 
@@ -81,6 +91,15 @@ static const char texture_fragment_shader_rgba[] =
 "   gl_FragColor = texture2D(tex, v_texcoord);\n"
 ;
 
+static const char texture_fragment_shader_bgra[] =
+"precision mediump float;\n"
+"varying vec2 v_texcoord;\n"
+"uniform sampler2D tex;\n"
+"void main()\n"
+"{\n"
+"   gl_FragColor = texture2D(tex, v_texcoord).bgra;\n"
+;
+
 static const char texture_fragment_shader_rgbx[] =
 "precision mediump float;\n"
 "varying vec2 v_texcoord;\n"
@@ -92,6 +111,46 @@ static const char texture_fragment_shader_rgbx[] =
 "   gl_FragColor.a = alpha;\n"
 ;
 
+/*
+ * Limited range YUV: luma from 16 to 235, chroma from 16 to 240 around
+ * 128, scaled up to full range RGB with the coefficients of yuvcoef.
+ */
+static const char texture_fragment_shader_nv12[] =
+"precision mediump float;\n"
+"varying vec2 v_texcoord;\n"
+"uniform sampler2D tex;\n"
+"uniform sampler2D tex1;\n"
+"uniform vec2 chromascale;\n"
+"uniform vec4 yuvcoef;\n"
+"void main()\n"
+"{\n"
+"   float y = texture2D(tex, v_texcoord).x;\n"
+"   vec2 uv = texture2D(tex1, v_texcoord * chromascale).xw;\n"
+;
+
+static const char texture_fragment_shader_yuv420[] =
+"precision mediump float;\n"
+"varying vec2 v_texcoord;\n"
+"uniform sampler2D tex;\n"
+"uniform sampler2D tex1;\n"
+"uniform sampler2D tex2;\n"
+"uniform vec2 chromascale;\n"
+"uniform vec4 yuvcoef;\n"
+"void main()\n"
+"{\n"
+"   float y = texture2D(tex, v_texcoord).x;\n"
+"   vec2 c = v_texcoord * chromascale;\n"
+"   vec2 uv = vec2(texture2D(tex1, c).x, texture2D(tex2, c).x);\n"
+;
+
+static const char fragment_yuv_to_rgb[] =
+"   y = 1.16438356 * (y - 0.0627451);\n"
+"   uv = uv - vec2(0.5);\n"
+"   gl_FragColor = vec4(y + yuvcoef.x * uv.y,\n"
+"       y - yuvcoef.y * uv.x - yuvcoef.z * uv.y,\n"
+"       y + yuvcoef.w * uv.x, 1.0);\n"
+;
+
 
 static int
 compile_shader(GLenum type, int count, const char **sources)
@@ -116,16 +175,31 @@ compile_shader(GLenum type, int count, const char **sources)
 gl_shader::gl_shader() {
 }
 
-int gl_shader::init() {
+int gl_shader::init(int variant) {
 	const GLchar *vssrc = vertex_shader_source;
 	const GLchar *fragment_source = texture_fragment_shader_rgba;
 	const char *fssrcs[3];
-	fssrcs[0] = fragment_source;
-	//fssrcs[1] = fragment_debug;
-	fssrcs[1] = fragment_brace;
-	int count = 2;
+	int count = 0;
 	GLint status;
 
+	switch (variant) {
+	case SHADER_BGRA:
+		fragment_source = texture_fragment_shader_bgra;
+		break;
+	case SHADER_NV12:
+		fragment_source = texture_fragment_shader_nv12;
+		break;
+	case SHADER_YUV420:
+		fragment_source = texture_fragment_shader_yuv420;
+		break;
+	}
+	fssrcs[count++] = fragment_source;
+	if (variant == SHADER_NV12 || variant == SHADER_YUV420) {
+		fssrcs[count++] = fragment_yuv_to_rgb;
+	}
+	//fssrcs[count++] = fragment_debug;
+	fssrcs[count++] = fragment_brace;
+
 	//glActiveTexture(GL_TEXTURE0);
 	vertex_shader = compile_shader(GL_VERTEX_SHADER, 1, &vssrc);
 	fragment_shader = compile_shader(GL_FRAGMENT_SHADER, count, fssrcs);
@@ -150,7 +224,11 @@ int gl_shader::init() {
 	tex_uniforms[1] = glGetUniformLocation(program, "tex1");
 	tex_uniforms[2] = glGetUniformLocation(program, "tex2");
 	alpha_uniform = glGetUniformLocation(program, "alpha");
+	texoffset_uniform = glGetUniformLocation(program, "texoffset");
+	texscale_uniform = glGetUniformLocation(program, "texscale");
 	color_uniform = glGetUniformLocation(program, "color");
+	chromascale_uniform = glGetUniformLocation(program, "chromascale");
+	yuvcoef_uniform = glGetUniformLocation(program, "yuvcoef");
 
 	return 0;
 }
@@ -167,6 +245,7 @@ static compositor_proxy_t compositor;
 static shell_proxy_t shell;
 static seat_proxy_t seat;
 static shm_proxy_t shm;
+static output_proxy_t output;
 
 // local objects
 static surface_proxy_t surface;
@@ -184,6 +263,7 @@ static egl_window_t egl_window;
 static EGLDisplay egldisplay;
 static EGLSurface eglsurface;
 static EGLContext eglcontext;
+static EGLContext egluploadcontext = EGL_NO_CONTEXT;
 
 
 void gl_print_error() {
@@ -210,7 +290,7 @@ void gl_print_error() {
 				error = "Unknown error";
 				break;
 		}
-		std::cout << "GL_" << error;
+		log_error(LOG_RENDER, "GL_%s", error.c_str());
 		err = glGetError();
 	}
 }
@@ -258,39 +338,133 @@ void display_wrapper_t::init_egl() {
 	if(eglcontext == EGL_NO_CONTEXT)
 		throw std::runtime_error("eglCreateContext");
 
+	// for the upload thread, it never draws so it needs no surface
+	if (has_egl_extension("EGL_KHR_surfaceless_context")) {
+		egluploadcontext = eglCreateContext(egldisplay, config,
+				eglcontext, context_attribs.data());
+	}
+
 	eglsurface = eglCreateWindowSurface(egldisplay, config, egl_window, NULL);
 	if(eglsurface == EGL_NO_SURFACE)
 		throw std::runtime_error("eglCreateWindowSurface");
 
 	if(eglMakeCurrent(egldisplay, eglsurface, eglsurface, eglcontext) == EGL_FALSE)
 		throw std::runtime_error("eglMakeCurrent");
+
+	// the simulated frame timer paces us, the host must not block swaps
+	if (void_clock::is_simulated())
+		eglSwapInterval(egldisplay, 0);
+
+	if (has_egl_extension("EGL_KHR_fence_sync")) {
+		create_sync = (PFNEGLCREATESYNCKHRPROC)
+			eglGetProcAddress("eglCreateSyncKHR");
+		destroy_sync = (PFNEGLDESTROYSYNCKHRPROC)
+			eglGetProcAddress("eglDestroySyncKHR");
+		client_wait_sync = (PFNEGLCLIENTWAITSYNCKHRPROC)
+			eglGetProcAddress("eglClientWaitSyncKHR");
+	}
+
+	if (metrics)
+		metrics->init_gpu_timer();
+}
+
+void display_wrapper_t::throttle_frames() {
+	if (!create_sync)
+		return;
+
+	// retire what the GPU is done with
+	while (!frame_fences.empty() &&
+			client_wait_sync(egldisplay, frame_fences.front(), 0, 0) ==
+			EGL_CONDITION_SATISFIED_KHR) {
+		destroy_sync(egldisplay, frame_fences.front());
+		frame_fences.pop_front();
+	}
+	// and wait when it is too far behind
+	while ((int)frame_fences.size() >= max_frames_in_flight) {
+		TRACE_SCOPE("fence wait");
+		client_wait_sync(egldisplay, frame_fences.front(),
+				EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, EGL_FOREVER_KHR);
+		destroy_sync(egldisplay, frame_fences.front());
+		frame_fences.pop_front();
+		fence_waits++;
+	}
 }
 
 void display_wrapper_t::draw(uint32_t serial) {
+	if (metrics)
+		metrics->begin_frame();
+
+	throttle_frames();
+
+	if (metrics)
+		metrics->begin_gpu();
+
 	// draw stuff
 	glClearColor(0, 0, 0, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT);
 
 
 	// schedule next draw
-	frame_cb = surface.frame();
-	frame_cb.on_done() = bind_mem_fn(&display_wrapper_t::draw, this);
+	if (!void_clock::is_simulated()) {
+		frame_cb = surface.frame();
+		frame_cb.on_done() = bind_mem_fn(&display_wrapper_t::draw, this);
+	}
 
 	//callback_t func = callback_dict["frame"];
 	//if (func) {
 	//	func(owner, userdata);
 	//}
-	frame_callback();
+	if (metrics)
+		metrics->begin_cpu();
+	bool drew = frame_callback();
+	if (metrics) {
+		metrics->end_cpu();
+		metrics->end_gpu();
+	}
 
-	// swap buffers
-	if(eglSwapBuffers(egldisplay, eglsurface) == EGL_FALSE)
-		throw std::runtime_error("eglSwapBuffers");
+	// swap buffers, the first frame maps the window
+	if (drew || !swap_time) {
+		TRACE_SCOPE("swap");
+		if(eglSwapBuffers(egldisplay, eglsurface) == EGL_FALSE)
+			throw std::runtime_error("eglSwapBuffers");
+		swap_time = void_clock::now();
+
+		if (create_sync) {
+			EGLSyncKHR fence = create_sync(egldisplay, EGL_SYNC_FENCE_KHR, NULL);
+			if (fence != EGL_NO_SYNC_KHR)
+				frame_fences.push_back(fence);
+		}
+	} else {
+		// keep the frame callback coming without a new buffer
+		surface.commit();
+		idle_frames++;
+	}
+
+	// build the next frame while the GPU executes this one
+	if (prepare_callback) {
+		if (metrics)
+			metrics->begin_cpu();
+		prepare_callback();
+		if (metrics)
+			metrics->end_cpu();
+	}
+
+	if (metrics)
+		metrics->end_frame();
 }
 
 
-display_wrapper_t::display_wrapper_t() {
+display_wrapper_t::display_wrapper_t()
+	: max_frames_in_flight(2), fence_waits(0), idle_frames(0),
+	create_sync(NULL), destroy_sync(NULL), client_wait_sync(NULL),
+	metrics(NULL), input_time(0), swap_time(0)
+{
+	has_pointer = false;
+	has_keyboard = false;
+
 	width = WIDTH;
 	height = HEIGHT;
+	scale = 1;
 
 	display = display_client_t(std::string("wayland-0"));
 	// retrieve global objects
@@ -304,19 +478,33 @@ display_wrapper_t::display_wrapper_t() {
 			registry.bind(name, seat, version);
 		else if(interface == "wl_shm")
 			registry.bind(name, shm, version);
+		else if(interface == "wl_output" && !output) {
+			registry.bind(name, output, std::min(version, 2u));
+			output.on_scale() = [&](int32_t s) {
+				scale = std::max(s, 1);
+			};
+		}
 	};
 	display.dispatch();
+	if (output) {
+		// the scale arrives with the output's initial events
+		display.roundtrip();
+	}
 
-	seat.on_capabilities() = [&](seat_capability capability) {
-		has_keyboard = capability & seat_capability::keyboard;
-		has_pointer = capability & seat_capability::pointer;
-	};
-	display.dispatch();
+	if (seat) {
+		seat.on_capabilities() = [&](seat_capability capability) {
+			has_keyboard = capability & seat_capability::keyboard;
+			has_pointer = capability & seat_capability::pointer;
+		};
+		display.dispatch();
+	}
 
+	// a headless host, e.g. for benchmarks, has no input devices;
+	// input can still be injected through the control socket
 	if(!has_keyboard)
-		throw std::runtime_error("No keyboard found.");
+		log_warn(LOG_INPUT, "No keyboard found.");
 	if(!has_pointer)
-		throw std::runtime_error("No pointer found.");
+		log_warn(LOG_INPUT, "No pointer found.");
 
 	// create a surface
 	surface = compositor.create_surface();
@@ -329,8 +517,21 @@ display_wrapper_t::display_wrapper_t() {
 	shell_surface.set_toplevel();
 
 	// Get input devices
+	if (has_pointer)
+		init_pointer();
+	if (has_keyboard)
+		init_keyboard();
+
+	// intitialize egl
+	//egl_window = egl_window_t(surface, 320, 240);
+	//init_egl();
+
+	// draw stuff
+	//draw();
+}
+
+void display_wrapper_t::init_pointer() {
 	pointer = seat.get_pointer();
-	keyboard = seat.get_keyboard();
 
 	// load cursor theme
 	cursor_theme = cursor_theme_t("default", 16, shm);
@@ -353,6 +554,7 @@ display_wrapper_t::display_wrapper_t() {
 
 	// window movement
 	pointer.on_button() = [&](uint32_t serial, uint32_t time, uint32_t button, pointer_button_state state) {
+		input_time = void_clock::now();
 		auto wrapper_on_buttion = [&]() {
 			if(button == BTN_LEFT && state == pointer_button_state::pressed) {
 				shell_surface.move(seat, serial);
@@ -366,8 +568,13 @@ display_wrapper_t::display_wrapper_t() {
 	};
 
 	pointer.on_motion() = [&](uint32_t time, fixed_t surface_x, fixed_t surface_y) {
+		input_time = void_clock::now();
 		pointer_motion_callback(time, surface_x, surface_y);
 	};
+}
+
+void display_wrapper_t::init_keyboard() {
+	keyboard = seat.get_keyboard();
 
 	// press 'q' to exit
 	keyboard.on_key() = [&](uint32_t, uint32_t, uint32_t key, keyboard_key_state state) {
@@ -375,13 +582,6 @@ display_wrapper_t::display_wrapper_t() {
 			running = false;
 		}
 	};
-
-	// intitialize egl
-	//egl_window = egl_window_t(surface, 320, 240);
-	//init_egl();
-
-	// draw stuff
-	//draw();
 }
 
 display_wrapper_t::~display_wrapper_t() {
@@ -390,6 +590,10 @@ display_wrapper_t::~display_wrapper_t() {
 	//	throw std::runtime_error("eglDestroyContext");
 	//if(eglTerminate(egldisplay) == EGL_FALSE)
 	//	throw std::runtime_error("eglTerminate");
+	for (auto fence : frame_fences)
+		destroy_sync(egldisplay, fence);
+	if (egluploadcontext != EGL_NO_CONTEXT)
+		eglDestroyContext(egldisplay, egluploadcontext);
 	eglDestroyContext(egldisplay, eglcontext);
 	eglTerminate(egldisplay);
 }
@@ -408,22 +612,65 @@ void display_wrapper_t::join() {
 }
 
 void display_wrapper_t::run() {
+	void_trace::set_thread_name("render");
+
 	// intitialize egl
-	egl_window = egl_window_t(surface, width, height);
+	// the window is in logical pixels, its buffer is scale times larger
+	egl_window = egl_window_t(surface, width * scale, height * scale);
+	if (scale > 1) {
+		surface.set_buffer_scale(scale);
+	}
 	init_egl();
 
-	shader.init();
-	initialized_shader.set_value(&shader);
+	for (int i = 0; i < SHADER_VARIANTS; i++) {
+		shaders[i].init(i);
+	}
+	initialized_shader.set_value(shaders);
+	// planes of one byte texels have rows of any length
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
 	// draw stuff
+	if (prepare_callback)
+		prepare_callback();
 	draw();
 
 	// event loop
 	running = true;
+	if (void_clock::is_simulated()) {
+		run_simulated();
+		return;
+	}
 	while(running)
 		display.dispatch();
 }
 
+/* frames come from the simulated clock instead of the host */
+void display_wrapper_t::run_simulated() {
+	uint64_t next = void_clock::now();
+	while (running) {
+		next += void_clock::get_frame_period();
+		while (running && !void_clock::wait_until(next, 10000000))
+			dispatch_pending();
+		if (!running)
+			break;
+		dispatch_pending();
+		draw();
+	}
+}
+
+/* host events that have arrived, without blocking */
+void display_wrapper_t::dispatch_pending() {
+	while (display.prepare_read() != 0)
+		display.dispatch_pending();
+	display.flush();
+	pollfd p = { display.get_fd(), POLLIN, 0 };
+	if (poll(&p, 1, 0) > 0)
+		display.read_events();
+	else
+		display.cancel_read();
+	display.dispatch_pending();
+}
+
 void display_wrapper_t::dispatch() {
 	display.dispatch();
 }
@@ -452,6 +699,10 @@ decltype(display_wrapper_t::frame_callback) &
 display_wrapper_t::on_frame() {
 	return frame_callback;
 }
+decltype(display_wrapper_t::prepare_callback) &
+display_wrapper_t::on_prepare() {
+	return prepare_callback;
+}
 decltype(display_wrapper_t::quit_callback) &
 display_wrapper_t::on_quit() {
 	return quit_callback;
@@ -474,6 +725,58 @@ gl_shader *display_wrapper_t::get_shader() {
 	return futp.get();
 }
 
+void display_wrapper_t::set_metrics(void_metrics *m) {
+	metrics = m;
+}
+
+uint64_t display_wrapper_t::get_input_time() {
+	return input_time;
+}
+
+uint64_t display_wrapper_t::get_swap_time() {
+	return swap_time;
+}
+
+void display_wrapper_t::set_max_frames_in_flight(int n) {
+	max_frames_in_flight = n < 1 ? 1 : n;
+}
+
+int display_wrapper_t::get_frames_in_flight() {
+	return frame_fences.size();
+}
+
+uint64_t display_wrapper_t::get_fence_waits() {
+	return fence_waits;
+}
+
+uint64_t display_wrapper_t::get_idle_frames() {
+	return idle_frames;
+}
+
+EGLDisplay display_wrapper_t::get_egl_display() {
+	return egldisplay;
+}
+
+bool display_wrapper_t::has_egl_extension(const char *name) {
+	const char *exts = eglQueryString(egldisplay, EGL_EXTENSIONS);
+	if (!exts)
+		return false;
+	std::string list = std::string(" ") + exts + " ";
+	return list.find(std::string(" ") + name + " ") != std::string::npos;
+}
+
+bool display_wrapper_t::bind_upload_context() {
+	if (egluploadcontext == EGL_NO_CONTEXT)
+		return false;
+	eglBindAPI(EGL_OPENGL_ES_API);
+	return eglMakeCurrent(egldisplay, EGL_NO_SURFACE, EGL_NO_SURFACE,
+			egluploadcontext) == EGL_TRUE;
+}
+
+void display_wrapper_t::release_upload_context() {
+	eglMakeCurrent(egldisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+
 int display_wrapper_t::get_width() {
 	return width;
 }
@@ -482,6 +785,16 @@ int display_wrapper_t::get_height() {
 	return height;
 }
 
+int display_wrapper_t::get_scale() {
+	return scale;
+}
+
+void display_wrapper_t::set_scale(int s) {
+	if (s > 0) {
+		scale = s;
+	}
+}
+
 
 
 
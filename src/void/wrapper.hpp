@@ -29,22 +29,47 @@
 
 #include <thread>
 #include <future>
+#include <deque>
+#include <atomic>
 #include <unordered_map>
 
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
 #include <GLES2/gl2.h>
 
+class void_metrics;
+
+/* fragment shaders by how the texture planes hold the pixels */
+enum gl_shader_variant {
+	SHADER_RGBA,
+	/* red and blue the other way round, argb8888 and xrgb8888 bytes
+	 * are B, G, R, A or X */
+	SHADER_BGRA,
+	/* luma, then interleaved chroma as luminance and alpha */
+	SHADER_NV12,
+	/* luma and the two chroma planes */
+	SHADER_YUV420,
+	SHADER_VARIANTS,
+};
+
 struct gl_shader {
 	GLuint program;
 	GLuint vertex_shader, fragment_shader;
 	GLint proj_uniform;
 	GLint tex_uniforms[3];
 	GLint alpha_uniform;
+	GLint texoffset_uniform;
+	GLint texscale_uniform;
 	GLint color_uniform;                        
+	/* chroma texcoords relative to the luma ones, and the YUV to RGB
+	 * coefficients for V in red, U and V in green, U in blue */
+	GLint chromascale_uniform;
+	GLint yuvcoef_uniform;
 	const char *vertex_source, *fragment_source;
 
 	gl_shader();
 
-	int init();
+	int init(int variant = SHADER_RGBA);
 };
 
 
@@ -66,16 +91,20 @@ private:
 	void *owner;
 	void *userdata;
 
-	gl_shader shader;
+	gl_shader shaders[SHADER_VARIANTS];
 	promise<gl_shader *> initialized_shader;
 
 	std::thread *td;
 
 	void init_egl();
+	void init_pointer();
+	void init_keyboard();
 
 	//callback_t frame_callback;
 	//callback_t quit_callback;
-	function<void()> frame_callback;
+	/* false when nothing changed and the shown frame still stands */
+	function<bool()> frame_callback;
+	function<void()> prepare_callback;
 	function<void()> quit_callback;
 	function<void(int32_t,int32_t)> pointer_enter_callback;
 	function<void(uint32_t,int32_t,int32_t)> pointer_motion_callback;
@@ -88,6 +117,28 @@ private:
 
 	int width;
 	int height;
+	/* output scale, physical pixels per logical pixel */
+	int scale;
+
+	/* one fence per swapped frame the GPU may still be working on */
+	std::deque<EGLSyncKHR> frame_fences;
+	int max_frames_in_flight;
+	uint64_t fence_waits;
+	uint64_t idle_frames;
+	PFNEGLCREATESYNCKHRPROC create_sync;
+	PFNEGLDESTROYSYNCKHRPROC destroy_sync;
+	PFNEGLCLIENTWAITSYNCKHRPROC client_wait_sync;
+
+	void_metrics *metrics;
+
+	/* when the host delivered the input event being handled */
+	uint64_t input_time;
+	/* when the last frame was swapped */
+	std::atomic<uint64_t> swap_time;
+
+	void throttle_frames();
+	void run_simulated();
+	void dispatch_pending();
 
 public:
 	display_wrapper_t();
@@ -108,6 +159,7 @@ public:
 	void *get_frame_buffer();
 
 	decltype(frame_callback) &on_frame();
+	decltype(prepare_callback) &on_prepare();
 	decltype(quit_callback) &on_quit();
 	decltype(pointer_enter_callback) &on_pointer_enter();
 	decltype(pointer_motion_callback) &on_pointer_motion();
@@ -120,9 +172,30 @@ public:
 
 	int get_width();
 	int get_height();
+	int get_scale();
+	/* before start(), overrides the scale of the host output */
+	void set_scale(int s);
 
 
 	gl_shader *get_shader();
+
+	/* set before start(), frames are timed into it */
+	void set_metrics(void_metrics *m);
+
+	/* valid inside the pointer callbacks */
+	uint64_t get_input_time();
+	uint64_t get_swap_time();
+
+	void set_max_frames_in_flight(int n);
+	int get_frames_in_flight();
+	uint64_t get_fence_waits();
+	uint64_t get_idle_frames();
+
+	EGLDisplay get_egl_display();
+	bool has_egl_extension(const char *name);
+	/* the upload context shares textures with the render context */
+	bool bind_upload_context();
+	void release_upload_context();
 };
 
 